@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <cstdlib>
+#include <new>
+
+// Allocator returning memory aligned on Alignment bytes,
+// so weight arrays start on a cache line
+template <class T, std::size_t Alignment = 64u>
+struct AlignedAllocator
+{
+    typedef T value_type;
+
+    template <class U>
+    struct rebind
+    {
+        typedef AlignedAllocator<U, Alignment> other;
+    };
+
+    AlignedAllocator() noexcept
+    {}
+
+    template <class U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept
+    {}
+
+    T* allocate(std::size_t n)
+    {
+        void* p = nullptr;
+        if (posix_memalign(&p, Alignment, n * sizeof(T)) != 0)
+            throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, std::size_t)
+    {
+        free(p);
+    }
+};
+
+template <class T, class U, std::size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&)
+{
+    return true;
+}
+
+template <class T, class U, std::size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&)
+{
+    return false;
+}
+
+template <class Weight>
+using BasicWeightVector = std::vector<Weight, AlignedAllocator<Weight>>;
+typedef BasicWeightVector<double> WeightVector;
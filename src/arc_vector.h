@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <iterator>
+
+#include "graph.h"
+
+// Arcs stored as a structure of arrays with 16 bits endpoints.
+// Elements are returned as Arc values, so it can be used as a
+// std::vector<Arc> for reading and appending.
+struct ArcVector
+{
+    typedef std::uint16_t Index;
+
+    std::vector<Index> sources;
+    std::vector<Index> source_nodes;
+    std::vector<Index> destinations;
+    std::vector<Index> destination_nodes;
+
+    struct const_iterator : std::iterator<std::forward_iterator_tag, Arc, std::ptrdiff_t, const Arc*, Arc>
+    {
+        const ArcVector* arcs;
+        unsigned i;
+
+        const_iterator(const ArcVector* t_arcs, unsigned t_i)
+            : arcs(t_arcs), i(t_i)
+        {}
+
+        Arc operator*() const
+        {
+            return (*arcs)[i];
+        }
+
+        const_iterator& operator++()
+        {
+            ++ i;
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const
+        {
+            return i == other.i;
+        }
+
+        bool operator!=(const const_iterator& other) const
+        {
+            return i != other.i;
+        }
+    };
+
+    unsigned size() const
+    {
+        return sources.size();
+    }
+
+    bool empty() const
+    {
+        return sources.empty();
+    }
+
+    void reserve(const unsigned n)
+    {
+        sources.reserve(n);
+        source_nodes.reserve(n);
+        destinations.reserve(n);
+        destination_nodes.reserve(n);
+    }
+
+    void clear()
+    {
+        sources.clear();
+        source_nodes.clear();
+        destinations.clear();
+        destination_nodes.clear();
+    }
+
+    void emplace_back(const int source, const int source_node, const int destination, const int destination_node)
+    {
+        sources.push_back(_narrow(source));
+        source_nodes.push_back(_narrow(source_node));
+        destinations.push_back(_narrow(destination));
+        destination_nodes.push_back(_narrow(destination_node));
+    }
+
+    void push_back(const Arc& arc)
+    {
+        emplace_back(arc.source, arc.source_node, arc.destination, arc.destination_node);
+    }
+
+    Arc operator[](const unsigned i) const
+    {
+        return Arc(sources[i], source_nodes[i], destinations[i], destination_nodes[i]);
+    }
+
+    Arc at(const unsigned i) const
+    {
+        if (i >= size())
+            throw std::out_of_range("ArcVector index out of range");
+        return (*this)[i];
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(this, 0u);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(this, size());
+    }
+
+    static Index _narrow(const int value)
+    {
+        if (value < 0 || value > std::numeric_limits<Index>::max())
+            throw std::runtime_error("Arc endpoint does not fit in 16 bits");
+        return (Index) value;
+    }
+};
@@ -0,0 +1,123 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <string>
+#include <cassert>
+#include <stdexcept>
+#include <limits>
+#include <algorithm>
+
+#include <boost/program_options.hpp>
+
+#include "timer.h"
+#include "aligned_allocator.h"
+#include "decoder/argmax.h"
+
+// Compares the argmax kernels of decoder/argmax.h on random weight blocks
+// of a given size, as scanned by the dual decoder
+
+std::string kernel_name(const ArgmaxKernel kernel)
+{
+    switch (kernel)
+    {
+        case ArgmaxKernel::avx512:
+            return "avx512";
+        case ArgmaxKernel::avx2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+template <class Weight>
+void benchmark(
+    const std::string& precision,
+    const std::vector<ArgmaxKernel>& kernels,
+    const unsigned block_size,
+    const unsigned n_blocks,
+    const unsigned n_repeat,
+    const unsigned seed
+)
+{
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<Weight> distribution(-1.0, 1.0);
+
+    // removed arcs have a -inf weight
+    BasicWeightVector<Weight> weights(block_size * n_blocks);
+    for (auto& w : weights)
+        w = (gen() % 8u == 0u ? -std::numeric_limits<Weight>::infinity() : distribution(gen));
+
+    std::vector<unsigned> expected(n_blocks);
+    for (unsigned b = 0u ; b < n_blocks ; ++b)
+        expected[b] = argmax_scalar(weights.data() + b * block_size, block_size);
+
+    for (ArgmaxKernel kernel : kernels)
+    {
+        auto argmax = Argmax<Weight>::function(kernel);
+
+        Timer timer;
+        unsigned checksum = 0u;
+        timer.start();
+        for (unsigned r = 0u ; r < n_repeat ; ++r)
+            for (unsigned b = 0u ; b < n_blocks ; ++b)
+                checksum += argmax(weights.data() + b * block_size, block_size);
+        timer.stop();
+
+        for (unsigned b = 0u ; b < n_blocks ; ++b)
+            if (argmax(weights.data() + b * block_size, block_size) != expected[b])
+                throw std::runtime_error("Kernel " + kernel_name(kernel) + " differs from the scalar argmax");
+
+        std::cout
+            << precision << "\t"
+            << kernel_name(kernel) << "\t"
+            << block_size << "\t"
+            << timer.milliseconds() << "\t"
+            << checksum
+            << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<unsigned> block_sizes;
+    unsigned n_elements;
+    unsigned n_repeat;
+    unsigned seed;
+
+    namespace po = boost::program_options;
+    po::options_description desc("Options");
+    desc.add_options()
+        ("block-size", po::value<std::vector<unsigned>>(&block_sizes)->multitoken(), "sizes of the weight blocks (default: 4 8 16 32 64 128 256)")
+        ("elements", po::value<unsigned>(&n_elements)->default_value(1u << 16), "number of weights per test")
+        ("repeat", po::value<unsigned>(&n_repeat)->default_value(1000u), "number of scans of the weights")
+        ("seed", po::value<unsigned>(&seed)->default_value(1u), "")
+    ;
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+    po::notify(vm);
+
+    if (block_sizes.size() == 0u)
+        block_sizes = {4u, 8u, 16u, 32u, 64u, 128u, 256u};
+
+    // kernels supported by this CPU
+    const ArgmaxKernel best = detect_argmax_kernel();
+    std::vector<ArgmaxKernel> kernels = {ArgmaxKernel::scalar};
+    if (best == ArgmaxKernel::avx2 || best == ArgmaxKernel::avx512)
+        kernels.push_back(ArgmaxKernel::avx2);
+    if (best == ArgmaxKernel::avx512)
+        kernels.push_back(ArgmaxKernel::avx512);
+
+    std::cout << "precision\tkernel\tblock\tms\tchecksum" << std::endl;
+    for (unsigned block_size : block_sizes)
+    {
+        if (block_size == 0u)
+            throw std::runtime_error("Block size must be positive");
+        const unsigned n_blocks = std::max(1u, n_elements / block_size);
+
+        benchmark<double>("double", kernels, block_size, n_blocks, n_repeat, seed);
+        benchmark<float>("float", kernels, block_size, n_blocks, n_repeat, seed);
+    }
+
+    return 0;
+}
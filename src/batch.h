@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+// Mini-batches of sentence indices for one training epoch.
+// The sentences are shuffled then sorted by length, so that the sentences
+// of a batch have similar sizes, and the batches are visited in random order.
+// With a batch size of 1, this is a plain shuffle of the data.
+template<class Sentence>
+std::vector<std::vector<unsigned>> make_batches(const std::vector<Sentence>& data, const unsigned batch_size)
+{
+    if (batch_size == 0u)
+        throw std::runtime_error("The batch size must be positive");
+
+    std::vector<unsigned> order(data.size());
+    for (unsigned i = 0u ; i < order.size() ; ++i)
+        order[i] = i;
+    std::random_shuffle(std::begin(order), std::end(order));
+
+    // stable: ties keep their random order
+    if (batch_size > 1u)
+        std::stable_sort(
+            std::begin(order),
+            std::end(order),
+            [&] (const unsigned lhs, const unsigned rhs)
+            {
+                return data.at(lhs).size() < data.at(rhs).size();
+            }
+        );
+
+    std::vector<std::vector<unsigned>> batches;
+    for (unsigned begin = 0u ; begin < order.size() ; begin += batch_size)
+    {
+        const unsigned end = std::min<unsigned>(begin + batch_size, order.size());
+        batches.emplace_back(std::begin(order) + begin, std::begin(order) + end);
+    }
+
+    if (batch_size > 1u)
+        std::random_shuffle(std::begin(batches), std::end(batches));
+
+    return batches;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+// Dynamic bitset stored in 64 bits words,
+// with the same accessors as std::vector<bool>
+struct Bitset
+{
+    typedef std::uint64_t Word;
+    static const unsigned word_size = 64u;
+
+    std::vector<Word> words;
+    unsigned n_bits = 0u;
+
+    struct reference
+    {
+        Word* word;
+        Word mask;
+
+        operator bool() const
+        {
+            return (*word & mask) != 0u;
+        }
+
+        reference& operator=(const bool value)
+        {
+            if (value)
+                *word |= mask;
+            else
+                *word &= ~mask;
+            return *this;
+        }
+
+        reference& operator=(const reference& other)
+        {
+            return *this = (bool) other;
+        }
+    };
+
+    Bitset()
+    {}
+
+    Bitset(const unsigned n, const bool value=false)
+    {
+        resize(n, value);
+    }
+
+    unsigned size() const
+    {
+        return n_bits;
+    }
+
+    void resize(const unsigned n, const bool value=false)
+    {
+        const unsigned previous_n_bits = n_bits;
+        words.resize((n + word_size - 1u) / word_size, 0u);
+        n_bits = n;
+
+        if (value)
+            for (unsigned i = previous_n_bits ; i < n ; ++i)
+                (*this)[i] = true;
+
+        _clear_padding();
+    }
+
+    bool operator[](const unsigned i) const
+    {
+        return (words[i / word_size] >> (i % word_size)) & 1u;
+    }
+
+    reference operator[](const unsigned i)
+    {
+        return reference{&words[i / word_size], Word(1u) << (i % word_size)};
+    }
+
+    bool at(const unsigned i) const
+    {
+        _check(i);
+        return (*this)[i];
+    }
+
+    reference at(const unsigned i)
+    {
+        _check(i);
+        return (*this)[i];
+    }
+
+    // number of bits set
+    unsigned count() const
+    {
+        unsigned n = 0u;
+        for (Word w : words)
+            n += __builtin_popcountll(w);
+        return n;
+    }
+
+    void reset()
+    {
+        std::fill(std::begin(words), std::end(words), 0u);
+    }
+
+    void set()
+    {
+        std::fill(std::begin(words), std::end(words), ~Word(0u));
+        _clear_padding();
+    }
+
+    void _clear_padding()
+    {
+        if (n_bits % word_size != 0u)
+            words.back() &= (Word(1u) << (n_bits % word_size)) - 1u;
+    }
+
+    void _check(const unsigned i) const
+    {
+        if (i >= n_bits)
+            throw std::out_of_range("Bitset index out of range");
+    }
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <vector>
+
+#include "status.h"
+#include "sgd.h"
+
+// Removes the disabled arcs and nodes from a Status so the decoders
+// and the subgradient only iterate over the remaining elements.
+// The first call saves the original problem, restore() maps the
+// solution back to the original arc and node ids.
+template <class Weight>
+struct BasicCompaction
+{
+    typedef BasicWeightVector<Weight> WeightVector;
+
+    bool compacted = false;
+
+    // original problem
+    ArcVector arcs;
+    std::vector<Node> nodes;
+    WeightVector original_weights;
+
+    // current id -> original id
+    std::vector<unsigned> arc_remap;
+    std::vector<unsigned> node_remap;
+
+    void compact(BasicStatus<Weight>& status, BasicSubgradient<Weight>& subgradient)
+    {
+        if (!compacted)
+        {
+            compacted = true;
+
+            arcs = status.arcs;
+            nodes = status.nodes;
+            original_weights = status.original_weights;
+
+            arc_remap.resize(status.arcs.size());
+            for (unsigned i = 0u ; i < arc_remap.size() ; ++i)
+                arc_remap[i] = i;
+            node_remap.resize(status.nodes.size());
+            for (unsigned i = 0u ; i < node_remap.size() ; ++i)
+                node_remap[i] = i;
+        }
+
+        // nodes
+        std::vector<int> new_node_index(status.nodes.size(), -1);
+        unsigned n_nodes = 0u;
+        for (unsigned i = 0u ; i < status.nodes.size() ; ++i)
+        {
+            if (!status.allowed_nodes[i])
+                continue;
+
+            new_node_index[i] = n_nodes;
+            status.nodes[n_nodes] = status.nodes[i];
+            status.node_weights[n_nodes] = status.node_weights[i];
+            node_remap[n_nodes] = node_remap[i];
+            ++ n_nodes;
+        }
+        status.nodes.erase(std::begin(status.nodes) + n_nodes, std::end(status.nodes));
+        status.node_weights.resize(n_nodes);
+        node_remap.resize(n_nodes);
+        status.allowed_nodes = Bitset(n_nodes, true);
+
+        for (int& node : status.selected_nodes)
+            if (node >= 0)
+                node = new_node_index[node];
+
+        // arcs
+        std::vector<int> new_arc_index(status.arcs.size(), -1);
+        ArcVector new_arcs;
+        new_arcs.reserve(status.count_available_arcs());
+        Bitset new_primal_arcs(status.count_available_arcs(), false);
+        unsigned n_arcs = 0u;
+        for (unsigned i = 0u ; i < status.arcs.size() ; ++i)
+        {
+            if (!status.allowed_arcs[i])
+                continue;
+
+            new_arc_index[i] = n_arcs;
+            new_arcs.push_back(status.arcs[i]);
+            new_primal_arcs[n_arcs] = status.primal_arcs[i];
+            status.original_weights[n_arcs] = status.original_weights[i];
+            status.cmsa_weights[n_arcs] = status.cmsa_weights[i];
+            status.incoming_weights[n_arcs] = status.incoming_weights[i];
+            status.outgoing_weights[n_arcs] = status.outgoing_weights[i];
+            arc_remap[n_arcs] = arc_remap[i];
+            ++ n_arcs;
+        }
+        status.arcs = std::move(new_arcs);
+        status.primal_arcs = std::move(new_primal_arcs);
+        status.original_weights.resize(n_arcs);
+        status.cmsa_weights.resize(n_arcs);
+        status.incoming_weights.resize(n_arcs);
+        status.outgoing_weights.resize(n_arcs);
+        arc_remap.resize(n_arcs);
+        status.allowed_arcs = Bitset(n_arcs, true);
+
+        status.init_available_counts();
+        status.build_arc_index();
+        subgradient.remap(n_arcs, new_arc_index);
+    }
+
+    void restore(BasicStatus<Weight>& status, BasicSubgradient<Weight>& subgradient)
+    {
+        if (!compacted)
+            return;
+
+        const Weight inf = std::numeric_limits<Weight>::infinity();
+
+        // nodes
+        WeightVector new_node_weights(nodes.size(), -inf);
+        Bitset new_allowed_nodes(nodes.size(), false);
+        for (unsigned i = 0u ; i < node_remap.size() ; ++i)
+        {
+            new_node_weights[node_remap[i]] = status.node_weights[i];
+            new_allowed_nodes[node_remap[i]] = status.allowed_nodes[i];
+        }
+        for (int& node : status.selected_nodes)
+            if (node >= 0)
+                node = node_remap[node];
+
+        status.nodes = nodes;
+        status.node_weights = std::move(new_node_weights);
+        status.allowed_nodes = std::move(new_allowed_nodes);
+
+        // arcs
+        std::vector<int> new_arc_index(arc_remap.begin(), arc_remap.end());
+        WeightVector new_cmsa_weights(arcs.size(), -inf);
+        WeightVector new_incoming_weights(arcs.size(), -inf);
+        WeightVector new_outgoing_weights(arcs.size(), -inf);
+        Bitset new_allowed_arcs(arcs.size(), false);
+        Bitset new_primal_arcs(arcs.size(), false);
+        for (unsigned i = 0u ; i < arc_remap.size() ; ++i)
+        {
+            new_cmsa_weights[arc_remap[i]] = status.cmsa_weights[i];
+            new_incoming_weights[arc_remap[i]] = status.incoming_weights[i];
+            new_outgoing_weights[arc_remap[i]] = status.outgoing_weights[i];
+            new_allowed_arcs[arc_remap[i]] = status.allowed_arcs[i];
+            new_primal_arcs[arc_remap[i]] = status.primal_arcs[i];
+        }
+
+        status.arcs = arcs;
+        status.original_weights = original_weights;
+        status.cmsa_weights = std::move(new_cmsa_weights);
+        status.incoming_weights = std::move(new_incoming_weights);
+        status.outgoing_weights = std::move(new_outgoing_weights);
+        status.allowed_arcs = std::move(new_allowed_arcs);
+        status.primal_arcs = std::move(new_primal_arcs);
+
+        status.init_available_counts();
+        status.build_arc_index();
+        subgradient.remap(arcs.size(), new_arc_index);
+
+        compacted = false;
+        arcs.clear();
+        nodes.clear();
+        original_weights.clear();
+        arc_remap.clear();
+        node_remap.clear();
+    }
+};
+
+typedef BasicCompaction<double> Compaction;
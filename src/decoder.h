@@ -5,6 +5,8 @@
 #include <map>
 #include <cstdlib>
 #include <cmath>
+#include <memory>
+#include <chrono>
 
 #include "lemon_inc.h"
 #include "graph.h"
@@ -14,11 +16,66 @@
 #include "graph_generator.h"
 #include "timer.h"
 #include "sgd.h"
+#include "msa_algorithm.h"
+#include "thread_pool.h"
 #include "reduction.h"
+#include "compaction.h"
 
+#include "decoder/msa.h"
 #include "decoder/dual.h"
 #include "decoder/primal.h"
 
+struct DecoderOptions
+{
+    MSAAlgorithm msa_algorithm = MSAAlgorithm::lemon;
+
+    // warm start the native MSA solver from the previous iteration
+    bool incremental_msa = false;
+    double incremental_msa_threshold = 0.25;
+
+    // solve the dual subproblems concurrently,
+    // only for sentences of at least parallel_min_length words
+    ThreadPool* thread_pool = nullptr;
+    unsigned parallel_min_length = 30u;
+
+    // with reduction, remove the disabled elements from the problem
+    // when the ratio of remaining arcs is below this value (0 to disable)
+    double compaction_threshold = 0.0;
+
+    // reduction passes and their scheduling, see ReductionSchedule
+    bool reduction_incoming = false;
+    bool reduction_outgoing = false;
+    bool adaptive_reduction = false;
+    unsigned reduction_max_interval = 16u;
+    double reduction_gap_ratio = 0.5;
+
+    // stop before convergence (0 to disable) when the duality gap is
+    // below gap_tolerance or relative_gap_tolerance * |dual|,
+    // or after time_budget_ms milliseconds, keeping the best primal
+    double gap_tolerance = 0.0;
+    double relative_gap_tolerance = 0.0;
+    double time_budget_ms = 0.0;
+
+    // decode with single precision weights, see decode_primal_with_precision()
+    bool single_precision = false;
+};
+
+struct ReductionStats
+{
+    Timer timer;
+    unsigned n_passes = 0u;
+    unsigned n_removed_nodes = 0u;
+    unsigned n_removed_arcs = 0u;
+
+    void add(const ReductionStats& other)
+    {
+        timer.add(other.timer);
+        n_passes += other.n_passes;
+        n_removed_nodes += other.n_removed_nodes;
+        n_removed_arcs += other.n_removed_arcs;
+    }
+};
+
 struct DecoderTimer
 {
     Timer total;
@@ -28,6 +85,45 @@ struct DecoderTimer
     Timer sgd_update;
     Timer reduction;
 
+    // per reduction pass
+    ReductionStats reduction_node;
+    ReductionStats reduction_incoming;
+    ReductionStats reduction_outgoing;
+
+    // primal decoder memoization
+    unsigned primal_cache_hits = 0u;
+    unsigned primal_cache_misses = 0u;
+
+    // dual iterations
+    unsigned n_iterations = 0u;
+    unsigned n_converged = 0u;
+
+    // sentences solved with a single MSA, one node per cluster being left
+    unsigned n_single_candidate = 0u;
+
+    // last decoded sentence, see write_sentence_stats()
+    bool sentence_converged = false;
+    unsigned sentence_iteration = 0u;
+
+    // sum the statistics of another decoding (e.g. of another sentence)
+    void add(const DecoderTimer& other)
+    {
+        total.add(other.total);
+        sgd.add(other.sgd);
+        solve_dual.add(other.solve_dual);
+        solve_primal.add(other.solve_primal);
+        sgd_update.add(other.sgd_update);
+        reduction.add(other.reduction);
+        reduction_node.add(other.reduction_node);
+        reduction_incoming.add(other.reduction_incoming);
+        reduction_outgoing.add(other.reduction_outgoing);
+        primal_cache_hits += other.primal_cache_hits;
+        primal_cache_misses += other.primal_cache_misses;
+        n_iterations += other.n_iterations;
+        n_converged += other.n_converged;
+        n_single_candidate += other.n_single_candidate;
+    }
+
     void stop()
     {
         total.stop(false);
@@ -36,9 +132,23 @@ struct DecoderTimer
         solve_primal.stop(false);
         sgd_update.stop(false);
         reduction.stop(false);
+        reduction_node.timer.stop(false);
+        reduction_incoming.timer.stop(false);
+        reduction_outgoing.timer.stop(false);
     }
 };
 
+std::ostream& operator<<(std::ostream& os, const ReductionStats& s)
+{
+    os
+        << s.timer.milliseconds() << "\t"
+        << s.n_passes << "\t"
+        << s.n_removed_nodes << "\t"
+        << s.n_removed_arcs
+    ;
+    return os;
+}
+
 std::ostream& operator<<(std::ostream& os, const DecoderTimer& t)  
 {  
     os
@@ -48,47 +158,160 @@ std::ostream& operator<<(std::ostream& os, const DecoderTimer& t)
         << t.solve_primal.milliseconds() << "\t"
         << t.sgd_update.milliseconds() << "\t"
         << t.reduction.milliseconds() << "\t"
+        << t.primal_cache_hits << "\t"
+        << t.primal_cache_misses << "\t"
+        << t.reduction_node << "\t"
+        << t.reduction_incoming << "\t"
+        << t.reduction_outgoing << "\t"
+        << t.n_iterations << "\t"
+        << t.n_converged << "\t"
+        << t.n_single_candidate << "\t"
     ;
     return os;
 }
 
+// column names of operator<<(std::ostream&, const DecoderTimer&)
+std::ostream& write_decoder_timer_header(std::ostream& os)
+{
+    os
+        << "total_ms\tsgd_ms\tdual_ms\tprimal_ms\tsgd_update_ms\treduction_ms\t"
+        << "primal_cache_hits\tprimal_cache_misses\t"
+        << "node_reduction_ms\tnode_reduction_passes\tnode_reduction_nodes\tnode_reduction_arcs\t"
+        << "incoming_reduction_ms\tincoming_reduction_passes\tincoming_reduction_nodes\tincoming_reduction_arcs\t"
+        << "outgoing_reduction_ms\toutgoing_reduction_passes\toutgoing_reduction_nodes\toutgoing_reduction_arcs\t"
+        << "iterations\tconverged\tsingle_candidate\t"
+    ;
+    return os;
+}
+
+// one line per sentence: converged, last dual iteration.
+// Not printed by the decoders themselves, so that callers decoding
+// sentences concurrently can output them in sentence order
+std::ostream& write_sentence_stats(std::ostream& os, const DecoderTimer& t)
+{
+    os << t.sentence_converged << "\t" << t.sentence_iteration << std::endl << std::flush;
+    return os;
+}
+
+template <class Weight>
 bool decode(
-    Status& status,
-    Subgradient& subgradient,
+    BasicStatus<Weight>& status,
+    BasicSubgradient<Weight>& subgradient,
     unsigned max_iteration,
     bool use_reduction,
+    const DecoderOptions& options,
     DecoderTimer& timer,
     bool verbose=false
 )
 {
     timer.total.start();
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(options.time_budget_ms);
 
-    DualDecoder dual_decoder(status.n_cluster, status.arcs, status.nodes);
-    PrimalDecoder primal_decoder(status);
+    // rebuilt after each compaction
+    std::unique_ptr<BasicDualDecoder<Weight>> dual_decoder;
+    auto build_dual_decoder = [&] ()
+    {
+        dual_decoder.reset();
+        dual_decoder.reset(new BasicDualDecoder<Weight>(status.n_cluster, status.arcs, status.nodes, options.msa_algorithm));
+        dual_decoder->cmsa_decoder.solver.incremental = options.incremental_msa;
+        dual_decoder->cmsa_decoder.solver.incremental_threshold = options.incremental_msa_threshold;
+        if (status.n_cluster > options.parallel_min_length)
+            dual_decoder->thread_pool = options.thread_pool;
+    };
+    build_dual_decoder();
+
+    BasicPrimalDecoder<Weight> primal_decoder(status);
+    BasicCompaction<Weight> compaction;
 
     status.allowed_arcs.resize(status.arcs.size(), true);
     status.allowed_nodes.resize(status.nodes.size(), true);
     status.primal_arcs.resize(status.arcs.size(), false);
+    status.init_available_counts();
 
     status.selected_nodes.resize(status.n_cluster);
+    status.build_arc_index();
 
 
-    remove_inaccessibles(status, dual_decoder);
+    remove_inaccessibles(status, *dual_decoder);
+
+    // with 1 node / cluster left, the primal is a plain arborescence
+    auto solve_single_candidate = [&] ()
+    {
+        for (unsigned i = 0u ; i < status.nodes.size() ; ++i)
+        {
+            if (status.allowed_nodes[i])
+            {
+                auto const& node = status.nodes[i];
+                status.selected_nodes[node.cluster] = i;
+            }
+        }
+        timer.solve_primal.start();
+        primal_decoder.update();
+        timer.solve_primal.stop();
+    };
 
     unsigned iteration = 0u;
     bool converged = false;
 
+    // nothing left to choose: skip the dual iterations
+    bool single_candidate = false;
+    if (status.count_available_nodes() == status.n_cluster)
+    {
+        solve_single_candidate();
+        if (std::isfinite(status.primal_weight))
+        {
+            status.dual_weight = status.primal_weight;
+            converged = true;
+            single_candidate = true;
+            ++ timer.n_single_candidate;
+        }
+    }
+
+    ReductionSchedule node_schedule(options.adaptive_reduction, options.reduction_max_interval, options.reduction_gap_ratio);
+    ReductionSchedule incoming_schedule(options.adaptive_reduction, options.reduction_max_interval, options.reduction_gap_ratio);
+    ReductionSchedule outgoing_schedule(options.adaptive_reduction, options.reduction_max_interval, options.reduction_gap_ratio);
+
+    // arc passes can make nodes inaccessible
+    auto run_reduction_pass = [&] (
+        bool (*pass)(BasicStatus<Weight>&, BasicDualDecoder<Weight>&, Weight),
+        ReductionSchedule& schedule,
+        ReductionStats& stats,
+        const Weight dual_weight,
+        const bool arc_pass
+    )
+    {
+        const double gap = dual_weight - status.primal_weight;
+        if (!schedule.should_run(iteration, gap))
+            return;
+
+        const unsigned n_nodes = status.count_available_nodes();
+        const unsigned n_arcs = status.count_available_arcs();
+
+        stats.timer.start();
+        if (pass(status, *dual_decoder, dual_weight) && arc_pass)
+            remove_inaccessibles(status, *dual_decoder);
+        stats.timer.stop();
+
+        const unsigned n_removed_nodes = n_nodes - status.count_available_nodes();
+        const unsigned n_removed_arcs = n_arcs - status.count_available_arcs();
+        ++ stats.n_passes;
+        stats.n_removed_nodes += n_removed_nodes;
+        stats.n_removed_arcs += n_removed_arcs;
+
+        schedule.update(iteration, gap, n_removed_nodes + n_removed_arcs);
+    };
+
 
     timer.sgd.start();
     unsigned nb_wrong = 0u;
-    for (; iteration < max_iteration; ++iteration)
+    for (; !single_candidate && iteration < max_iteration; ++iteration)
     {
         subgradient.new_iteration();
 
         bool primal_change = (iteration == 0u ? true : false);
 
         timer.solve_dual.start();
-        double dual_weight = dual_decoder.maximize(
+        Weight dual_weight = dual_decoder->maximize(
                 // TODO: decoder should save a reference to the status object
                 status.cmsa_weights,
                 status.incoming_weights,
@@ -97,17 +320,17 @@ bool decode(
                 [&] (const int i)
                 {
                     assert(status.allowed_arcs[i]);
-                    (*subgradient.gradient_cmsa)[i] += 1.0;
+                    subgradient.add_cmsa(i);
                 },
                 [&] (const int i)
                 {
                     assert(status.allowed_arcs[i]);
-                    (*subgradient.gradient_incoming)[i] += 1.0;
+                    subgradient.add_incoming(i);
                 },
                 [&] (const int i)
                 {
                     assert(status.allowed_arcs[i]);
-                    (*subgradient.gradient_outgoing)[i] += 1.0;
+                    subgradient.add_outgoing(i);
                 },
                 [&] (const int i)
                 {
@@ -157,34 +380,40 @@ bool decode(
             break;
         }
 
+        // the primal is close enough to the optimal
+        const double gap = status.dual_weight - status.primal_weight;
+        if (
+            std::isfinite(gap)
+            &&
+            (
+                (options.gap_tolerance > 0.0 && gap <= options.gap_tolerance)
+                ||
+                (options.relative_gap_tolerance > 0.0 && gap <= options.relative_gap_tolerance * std::abs(status.dual_weight))
+            )
+        )
+            break;
+
 
-        unsigned nb_available_nodes = status.count_available_nodes();
-        unsigned nb_available_arcs = status.count_available_arcs();
         // problem reduction
         if (use_reduction)
         {
             timer.reduction.start();
-            reduction(status, dual_decoder, dual_weight);
+            run_reduction_pass(reduction_node<Weight>, node_schedule, timer.reduction_node, dual_weight, false);
+            if (options.reduction_incoming)
+                run_reduction_pass(reduction_incoming<Weight>, incoming_schedule, timer.reduction_incoming, dual_weight, true);
+            if (options.reduction_outgoing)
+                run_reduction_pass(reduction_outgoing_0<Weight>, outgoing_schedule, timer.reduction_outgoing, dual_weight, true);
             
             // Convergence test
             // if we have 1 node / cluster or n arcs left, we're done
-            if (nb_available_nodes == status.n_cluster)
+            if (status.count_available_nodes() == status.n_cluster)
             {
-                // set the nodes and then build the primal
-                for (unsigned i = 0u ; i < status.nodes.size() ; ++i)
-                {
-                    if (status.allowed_nodes[i])
-                    {
-                        auto const& node = status.nodes[i];
-                        status.selected_nodes[node.cluster] = i;
-                    }
-                }
-                primal_decoder.update();
+                solve_single_candidate();
 
                 converged = true;
                 break;
             }
-            if (nb_available_arcs == status.n_cluster - 1)
+            if (status.count_available_arcs() == status.n_cluster - 1)
             {
                 // TODO: pas sur que ça marche => on ne met pas à jour le score du primal
                 status.primal_from_available_arcs();
@@ -192,6 +421,14 @@ bool decode(
                 break;
             }
 
+            if (status.count_available_arcs() < options.compaction_threshold * status.arcs.size())
+            {
+                compaction.compact(status, subgradient);
+                // cached solutions use the previous arc and node ids
+                primal_decoder.cache.clear();
+                build_dual_decoder();
+            }
+
             timer.reduction.stop();
         }
 
@@ -215,60 +452,119 @@ bool decode(
                 << "\t" 
                 << nb_wrong // will be invalid at the last iteration
                 << "\t"
-                << nb_available_nodes << "/" << status.allowed_nodes.size()
+                << status.count_available_nodes() << "/" << status.allowed_nodes.size()
                 << "\t"
-                << nb_available_arcs << "/" << status.allowed_arcs.size()
+                << status.count_available_arcs() << "/" << status.allowed_arcs.size()
                 << std::endl;
         }
+
+        if (options.time_budget_ms > 0.0 && std::chrono::steady_clock::now() >= deadline)
+            break;
     }
 
+    // back to the original arc and node ids
+    compaction.restore(status, subgradient);
+
+    if (!single_candidate)
+        timer.n_iterations += std::min(iteration + 1u, max_iteration);
+    if (converged)
+        ++ timer.n_converged;
+    timer.primal_cache_hits += primal_decoder.n_cache_hits;
+    timer.primal_cache_misses += primal_decoder.n_cache_misses;
+    timer.sentence_converged = converged;
+    timer.sentence_iteration = iteration;
     timer.stop();
-    std::cout << converged << "\t" << iteration << std::endl << std::flush;
 
 
     return converged;
 }
 
+// every cluster has a single candidate node: the joint problem is a plain
+// maximum spanning arborescence, solved without the dual decoder.
+// Returns false if there is no arborescence.
+template <class Weight>
+bool decode_single_candidate(BasicStatus<Weight>& status, DecoderTimer& timer)
+{
+    timer.total.start();
+
+    status.primal_arcs.resize(status.arcs.size(), false);
+    status.selected_nodes.resize(status.n_cluster);
+    for (unsigned i = 0u ; i < status.nodes.size() ; ++i)
+        status.selected_nodes[status.nodes[i].cluster] = i;
+    status.build_arc_index();
+
+    BasicPrimalDecoder<Weight> primal_decoder(status);
+    timer.solve_primal.start();
+    const bool feasible = primal_decoder.update();
+    timer.solve_primal.stop();
+
+    if (feasible)
+    {
+        status.dual_weight = status.primal_weight;
+        ++ timer.n_converged;
+        ++ timer.n_single_candidate;
+    }
+    // same statistics as a decode() converging before the first iteration
+    timer.sentence_converged = feasible;
+    timer.sentence_iteration = 0u;
+    timer.total.stop();
+
+    return feasible;
+}
+
 template <
+    class Weight,
     class SetPosOp,
     class SetHeadOp
 >
 bool decode_primal(
-    Status& status,
+    BasicStatus<Weight>& status,
     const StepsizeOptions& stepsize_options,
     unsigned max_iteration,
     bool use_reduction,
+    const DecoderOptions& decoder_options,
     SetPosOp set_pos_op,
     SetHeadOp set_head_op,
     DecoderTimer& timer,
     bool verbose=false
 )
 {
+    // not built by the single candidate fast path
+    std::unique_ptr<BasicSubgradient<Weight>> subgradient;
+    bool converged;
 
-    // set submodel weights
-    status.cmsa_weights.clear();
-    status.incoming_weights.clear();
-    status.outgoing_weights.clear();
-    status.cmsa_weights.reserve(status.original_weights.size());
-    status.incoming_weights.reserve(status.original_weights.size());
-    status.outgoing_weights.reserve(status.original_weights.size());
-    for (double weight : status.original_weights)
+    if (status.nodes.size() == status.n_cluster && decode_single_candidate(status, timer))
     {
-        double w = weight / 3.0;
-        status.cmsa_weights.push_back(w);
-        status.incoming_weights.push_back(w);
-        status.outgoing_weights.push_back(w);
+        converged = true;
     }
+    else
+    {
+        // set submodel weights
+        status.cmsa_weights.clear();
+        status.incoming_weights.clear();
+        status.outgoing_weights.clear();
+        status.cmsa_weights.reserve(status.original_weights.size());
+        status.incoming_weights.reserve(status.original_weights.size());
+        status.outgoing_weights.reserve(status.original_weights.size());
+        for (Weight weight : status.original_weights)
+        {
+            Weight w = weight / Weight(3);
+            status.cmsa_weights.push_back(w);
+            status.incoming_weights.push_back(w);
+            status.outgoing_weights.push_back(w);
+        }
 
-    Subgradient subgradient(stepsize_options, status);
-    bool converged = decode(
-        status,
-        subgradient,
-        max_iteration,
-        use_reduction,
-        timer,
-        verbose
-    );
+        subgradient.reset(new BasicSubgradient<Weight>(stepsize_options, status));
+        converged = decode(
+            status,
+            *subgradient,
+            max_iteration,
+            use_reduction,
+            decoder_options,
+            timer,
+            verbose
+        );
+    }
 
 
     // do we have a finite primal solution ?
@@ -283,12 +579,7 @@ bool decode_primal(
             auto const& arc = status.arcs[i];
 
             primal_score += status.original_weights[i];
-            for (unsigned k = 0u ; k <  status.nodes.size() ; ++k)
-            {
-                auto const& node = status.nodes.at(k);
-                if (node.cluster == arc.destination && node.node == arc.destination_node)
-                    primal_score += status.node_weights.at(k);
-            }
+            primal_score += status.node_weights.at(status.node_index(arc.destination, arc.destination_node));
 
             set_pos_op(arc.destination, arc.destination_node);
             set_head_op(arc.destination, arc.source);
@@ -299,9 +590,9 @@ bool decode_primal(
     else
     {
         // we return the last solution from the CMSA
-        for (unsigned i = 0u ; i < subgradient.gradient_cmsa->size() ; ++i)
+        for (unsigned i = 0u ; subgradient && i < subgradient->gradient_cmsa->size() ; ++i)
         {
-            if (NEARLY_EQ_TOL((*subgradient.gradient_cmsa)[i], 0.0))
+            if (NEARLY_EQ_TOL((*subgradient->gradient_cmsa)[i], 0.0))
                 continue;
 
             auto const& arc = status.arcs[i];
@@ -315,6 +606,35 @@ bool decode_primal(
     return converged;
 }
 
+// decode_primal() in the precision selected by the options:
+// with single_precision, the problem is decoded on a float copy of the status
+template <
+    class SetPosOp,
+    class SetHeadOp
+>
+bool decode_primal_with_precision(
+    Status& status,
+    const StepsizeOptions& stepsize_options,
+    unsigned max_iteration,
+    bool use_reduction,
+    const DecoderOptions& decoder_options,
+    SetPosOp set_pos_op,
+    SetHeadOp set_head_op,
+    DecoderTimer& timer,
+    bool verbose=false
+)
+{
+    if (!decoder_options.single_precision)
+        return decode_primal(status, stepsize_options, max_iteration, use_reduction, decoder_options, set_pos_op, set_head_op, timer, verbose);
+
+    BasicStatus<float> single_status(status);
+    const bool converged = decode_primal(single_status, stepsize_options, max_iteration, use_reduction, decoder_options, set_pos_op, set_head_op, timer, verbose);
+    status.primal_weight = single_status.primal_weight;
+    status.dual_weight = single_status.dual_weight;
+
+    return converged;
+}
+
 
 /*
 template <
@@ -359,9 +679,8 @@ bool decode_dual(
     nn.compute_exprs(
         cg,
         sentence,
-        [&] (const Arc& arc, const double weight, dynet::expr::Expression& expr) -> void
+        [&] (const Arc& arc, const double weight) -> void
         {
-            unused_parameter(expr);
             unused_parameter(arc);
 
             status.original_weights.push_back(weight);
@@ -371,9 +690,8 @@ bool decode_dual(
             status.incoming_weights.push_back(w);
             status.outgoing_weights.push_back(w);
         },
-        [&] (const Node node, const double weight, dynet::expr::Expression& expr) -> void
+        [&] (const Node node, const double weight) -> void
         {
-            unused_parameter(expr);
             unused_parameter(node);
 
             status.node_weights.push_back(weight);
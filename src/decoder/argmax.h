@@ -0,0 +1,213 @@
+#pragma once
+
+// Argmax over a contiguous block of weights: index of the first maximum.
+// The AVX2 and AVX-512 kernels are compiled with target attributes and
+// chosen at runtime from the CPU features, with a scalar fallback,
+// so the binary doesn't depend on the build machine.
+// Every kernel returns the same index as the scalar one.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ARGMAX_X86 1
+#include <immintrin.h>
+#endif
+
+#include <limits>
+
+enum struct ArgmaxKernel { scalar, avx2, avx512 };
+
+template <class Weight>
+unsigned argmax_scalar(const Weight* weights, const unsigned size)
+{
+    unsigned max_index = 0u;
+    Weight max_weight = weights[0u];
+    for (unsigned i = 1u ; i < size ; ++i)
+    {
+        if (weights[i] > max_weight)
+        {
+            max_weight = weights[i];
+            max_index = i;
+        }
+    }
+    return max_index;
+}
+
+#ifdef ARGMAX_X86
+
+// two passes: vector maximum, then first position equal to it.
+// The AVX-512 maximum is the masked form with a full mask: with GCC 12,
+// the unmasked intrinsics and _mm512_reduce_max_* pass an undefined
+// vector that triggers -Wmaybe-uninitialized in optimized builds.
+// Below ARGMAX_MIN_SIMD_SIZE weights, the scalar loop is faster
+// (see argmax-benchmark)
+#define ARGMAX_MIN_SIMD_SIZE 32u
+
+__attribute__((target("avx2")))
+inline unsigned argmax_avx2(const double* weights, const unsigned size)
+{
+    if (size < ARGMAX_MIN_SIMD_SIZE)
+        return argmax_scalar(weights, size);
+
+    __m256d v_max = _mm256_set1_pd(-std::numeric_limits<double>::infinity());
+    unsigned i = 0u;
+    for (; i + 4u <= size ; i += 4u)
+        v_max = _mm256_max_pd(v_max, _mm256_loadu_pd(weights + i));
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, v_max);
+    double max_weight = lanes[0];
+    for (unsigned k = 1u ; k < 4u ; ++k)
+        max_weight = (lanes[k] > max_weight ? lanes[k] : max_weight);
+    for (; i < size ; ++i)
+        max_weight = (weights[i] > max_weight ? weights[i] : max_weight);
+
+    const __m256d v_target = _mm256_set1_pd(max_weight);
+    for (i = 0u ; i + 4u <= size ; i += 4u)
+    {
+        const int mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(weights + i), v_target, _CMP_EQ_OQ));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    for (; i < size ; ++i)
+        if (weights[i] == max_weight)
+            return i;
+    return 0u;
+}
+
+__attribute__((target("avx2")))
+inline unsigned argmax_avx2(const float* weights, const unsigned size)
+{
+    if (size < ARGMAX_MIN_SIMD_SIZE)
+        return argmax_scalar(weights, size);
+
+    __m256 v_max = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    unsigned i = 0u;
+    for (; i + 8u <= size ; i += 8u)
+        v_max = _mm256_max_ps(v_max, _mm256_loadu_ps(weights + i));
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, v_max);
+    float max_weight = lanes[0];
+    for (unsigned k = 1u ; k < 8u ; ++k)
+        max_weight = (lanes[k] > max_weight ? lanes[k] : max_weight);
+    for (; i < size ; ++i)
+        max_weight = (weights[i] > max_weight ? weights[i] : max_weight);
+
+    const __m256 v_target = _mm256_set1_ps(max_weight);
+    for (i = 0u ; i + 8u <= size ; i += 8u)
+    {
+        const int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(weights + i), v_target, _CMP_EQ_OQ));
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+    for (; i < size ; ++i)
+        if (weights[i] == max_weight)
+            return i;
+    return 0u;
+}
+
+__attribute__((target("avx512f")))
+inline unsigned argmax_avx512(const double* weights, const unsigned size)
+{
+    if (size < ARGMAX_MIN_SIMD_SIZE)
+        return argmax_scalar(weights, size);
+
+    __m512d v_max = _mm512_set1_pd(-std::numeric_limits<double>::infinity());
+    unsigned i = 0u;
+    for (; i + 8u <= size ; i += 8u)
+        v_max = _mm512_mask_max_pd(v_max, 0xFF, v_max, _mm512_loadu_pd(weights + i));
+
+    double lanes[8];
+    _mm512_storeu_pd(lanes, v_max);
+    double max_weight = lanes[0];
+    for (unsigned k = 1u ; k < 8u ; ++k)
+        max_weight = (lanes[k] > max_weight ? lanes[k] : max_weight);
+    for (; i < size ; ++i)
+        max_weight = (weights[i] > max_weight ? weights[i] : max_weight);
+
+    const __m512d v_target = _mm512_set1_pd(max_weight);
+    for (i = 0u ; i + 8u <= size ; i += 8u)
+    {
+        const unsigned mask = _mm512_cmp_pd_mask(_mm512_loadu_pd(weights + i), v_target, _CMP_EQ_OQ);
+        if (mask != 0u)
+            return i + __builtin_ctz(mask);
+    }
+    for (; i < size ; ++i)
+        if (weights[i] == max_weight)
+            return i;
+    return 0u;
+}
+
+__attribute__((target("avx512f")))
+inline unsigned argmax_avx512(const float* weights, const unsigned size)
+{
+    if (size < ARGMAX_MIN_SIMD_SIZE)
+        return argmax_scalar(weights, size);
+
+    __m512 v_max = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+    unsigned i = 0u;
+    for (; i + 16u <= size ; i += 16u)
+        v_max = _mm512_mask_max_ps(v_max, 0xFFFF, v_max, _mm512_loadu_ps(weights + i));
+
+    float lanes[16];
+    _mm512_storeu_ps(lanes, v_max);
+    float max_weight = lanes[0];
+    for (unsigned k = 1u ; k < 16u ; ++k)
+        max_weight = (lanes[k] > max_weight ? lanes[k] : max_weight);
+    for (; i < size ; ++i)
+        max_weight = (weights[i] > max_weight ? weights[i] : max_weight);
+
+    const __m512 v_target = _mm512_set1_ps(max_weight);
+    for (i = 0u ; i + 16u <= size ; i += 16u)
+    {
+        const unsigned mask = _mm512_cmp_ps_mask(_mm512_loadu_ps(weights + i), v_target, _CMP_EQ_OQ);
+        if (mask != 0u)
+            return i + __builtin_ctz(mask);
+    }
+    for (; i < size ; ++i)
+        if (weights[i] == max_weight)
+            return i;
+    return 0u;
+}
+
+#endif
+
+// best kernel supported by the CPU
+inline ArgmaxKernel detect_argmax_kernel()
+{
+#ifdef ARGMAX_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return ArgmaxKernel::avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return ArgmaxKernel::avx2;
+#endif
+    return ArgmaxKernel::scalar;
+}
+
+template <class Weight>
+struct Argmax
+{
+    typedef unsigned (*Function)(const Weight*, unsigned);
+
+    static Function function(const ArgmaxKernel kernel)
+    {
+        switch (kernel)
+        {
+#ifdef ARGMAX_X86
+            case ArgmaxKernel::avx512:
+                return static_cast<Function>(argmax_avx512);
+            case ArgmaxKernel::avx2:
+                return static_cast<Function>(argmax_avx2);
+#endif
+            default:
+                return argmax_scalar<Weight>;
+        }
+    }
+
+    // kernel used by the decoders, detected once
+    static Function best()
+    {
+        static const Function f = function(detect_argmax_kernel());
+        return f;
+    }
+};
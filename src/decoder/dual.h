@@ -1,24 +1,53 @@
 #pragma once
 
-struct CMSADecoder
+#include "msa_algorithm.h"
+#include "thread_pool.h"
+#include "decoder/msa.h"
+#include "decoder/argmax.h"
+
+// The argmax subproblems are solved on contiguous weight blocks:
+// the weights of the arcs of each index list are gathered once per call
+// to solve(), then scanned with the SIMD kernels of decoder/argmax.h.
+
+template <class Weight>
+struct BasicCMSADecoder
 {
+    typedef BasicWeightVector<Weight> WeightVector;
+
     int cluster_size;
+    MSAAlgorithm algorithm;
 
     LDigraph lemon_graph;
     LArcMap arc_weights;
 
+    // native solver, used if algorithm != lemon
+    BasicArborescenceSolver<Weight> solver;
+
+    // parallel arcs between two clusters
     std::vector<std::vector<unsigned>> lemon_arcs;
 
+    // lemon_arcs concatenated, their weights are gathered in _block_weights
+    std::vector<unsigned> _block_arcs;
+    std::vector<unsigned> _block_begin;
+    WeightVector _block_weights;
+    typename Argmax<Weight>::Function _argmax;
+
     // used to build solution & for problem reduction
     std::vector<unsigned> _arc_cache;
 
-    CMSADecoder(unsigned t_cluster_size, const std::vector<Arc>& arcs)
-        : cluster_size(t_cluster_size), arc_weights(lemon_graph)
+    // arc index selected for each cluster by the last call to solve()
+    std::vector<unsigned> _solution;
+
+    BasicCMSADecoder(unsigned t_cluster_size, const ArcVector& arcs, MSAAlgorithm t_algorithm=MSAAlgorithm::lemon)
+        : cluster_size(t_cluster_size), algorithm(t_algorithm), arc_weights(lemon_graph), solver(t_cluster_size)
     {
-        for (int i = 0 ; i < cluster_size; ++i)
+        if (algorithm == MSAAlgorithm::lemon)
         {
-            auto node = lemon_graph.addNode();
-            assert(lemon_graph.id(node) == i);
+            for (int i = 0 ; i < cluster_size; ++i)
+            {
+                auto node = lemon_graph.addNode();
+                assert(lemon_graph.id(node) == i);
+            }
         }
 
         std::map<std::pair<int, int>, int> lemon_arcs_eq;
@@ -30,11 +59,17 @@ struct CMSADecoder
 
             if (it == std::end(lemon_arcs_eq))
             {
-                auto lemon_arc = lemon_graph.addArc(
-                        lemon_graph.nodeFromId(arc.source), 
-                        lemon_graph.nodeFromId(arc.destination)
-                );
-                int id = lemon_graph.id(lemon_arc);
+                int id;
+                if (algorithm == MSAAlgorithm::lemon)
+                {
+                    auto lemon_arc = lemon_graph.addArc(
+                            lemon_graph.nodeFromId(arc.source), 
+                            lemon_graph.nodeFromId(arc.destination)
+                    );
+                    id = lemon_graph.id(lemon_arc);
+                }
+                else
+                    id = solver.add_arc(arc.source, arc.destination);
                 assert(id == (int) lemon_arcs.size());
 
                 lemon_arcs_eq[carc] = id;
@@ -48,32 +83,70 @@ struct CMSADecoder
         }
 
         _arc_cache.resize(lemon_arcs.size());
+        _solution.resize(cluster_size);
+
+        _block_begin.push_back(0u);
+        for (auto const& indices : lemon_arcs)
+        {
+            _block_arcs.insert(std::end(_block_arcs), std::begin(indices), std::end(indices));
+            _block_begin.push_back(_block_arcs.size());
+        }
+        _block_weights.resize(_block_arcs.size());
+        _argmax = Argmax<Weight>::best();
+
+        if (algorithm == MSAAlgorithm::dense)
+            solver.dense = true;
+        else if (algorithm == MSAAlgorithm::automatic)
+            solver.dense = BasicArborescenceSolver<Weight>::prefer_dense(cluster_size, lemon_arcs.size());
     }
 
     template<class Operator>
-    double maximize(const std::vector<double>& weights, Operator op)
+    Weight maximize(const WeightVector& weights, Operator op)
     {
+        Weight weight = solve(weights);
+        apply(op);
+        return weight;
+    }
+
+    // call the operator on the arcs of the last call to solve()
+    template<class Operator>
+    void apply(Operator op) const
+    {
+        for (int i = 1 ; i < cluster_size ; ++i)
+            op(_solution[i]);
+    }
+
+    Weight solve(const WeightVector& weights)
+    {
+        for (unsigned k = 0u ; k < _block_arcs.size() ; ++k)
+            _block_weights[k] = weights[_block_arcs[k]];
+
         for (int lemon_id = 0 ; lemon_id < (int) lemon_arcs.size() ; ++ lemon_id)
         {
-            auto const& indices = lemon_arcs[lemon_id];
-            
-            unsigned max_index = indices[0u];
-            double max_weight = weights[max_index];
+            const unsigned begin = _block_begin[lemon_id];
+            const unsigned size = _block_begin[lemon_id + 1] - begin;
+            const unsigned best = (size == 1u ? 0u : _argmax(_block_weights.data() + begin, size));
 
-            for (unsigned i = 1u ; i < indices.size() ; ++i)
-            {
-                double w = weights.at(indices.at(i));
-                if (w > max_weight)
-                {
-                    max_index = indices[i];
-                    max_weight = w;
-                }
-            }
+            const unsigned max_index = _block_arcs[begin + best];
+            const Weight max_weight = _block_weights[begin + best];
 
-            arc_weights[lemon_graph.arcFromId(lemon_id)] = -max_weight;
+            if (algorithm == MSAAlgorithm::lemon)
+                arc_weights[lemon_graph.arcFromId(lemon_id)] = -max_weight;
+            else
+                solver.weights[lemon_id] = max_weight;
             _arc_cache[lemon_id] = max_index;
         }
 
+        if (algorithm != MSAAlgorithm::lemon)
+        {
+            if (!solver.run(0))
+                throw std::runtime_error("Failed to produce arborescence");
+
+            for (int i = 1 ; i < cluster_size ; ++i)
+                _solution[i] = _arc_cache[solver.pred[i]];
+
+            return solver.weight;
+        }
 
         MSA msa(lemon_graph, arc_weights);
         msa.run(lemon_graph.nodeFromId(0));
@@ -89,108 +162,118 @@ struct CMSADecoder
             }
 
 
-            op(_arc_cache[lemon_graph.id(msa_pred)]);
+            _solution[i] = _arc_cache[lemon_graph.id(msa_pred)];
         }
 
         return -msa.arborescenceCost();
     }
 };
 
-struct NodeDecoder
+template <class Weight>
+struct BasicNodeDecoder
 {
+    typedef BasicWeightVector<Weight> WeightVector;
+
     std::vector<int> incoming_indices;
     std::vector<std::vector<int>> outgoing_indices;
     int node_index;
 
-    // used for problem reduction
-    // TODO: also use this instead of recomputing the max
-    // when computing the solution
+    // position of the index lists in the blocks of the cluster decoder,
+    // outgoing_indices[c] is at [_outgoing_begin[c], _outgoing_begin[c + 1])
+    unsigned _incoming_begin;
+    std::vector<unsigned> _outgoing_begin;
+
+    // argmax of the last call to maximize(),
+    // used to build the solution and for problem reduction
     std::vector<int> _outgoing_selected;
     int _incoming_selected;
 
-    NodeDecoder(const int t_node_index, const int t_cluster_size)
+    BasicNodeDecoder(const int t_node_index, const int t_cluster_size)
         : outgoing_indices(t_cluster_size), node_index(t_node_index), _outgoing_selected(t_cluster_size)
     {};
 
-    template<class Op1, class Op2, class Op3>
-    double maximize(
-        const std::vector<double>& incoming_weights, 
-        const std::vector<double>& outgoing_weights,
-        const std::vector<double>& node_weights,
-        Op1 op_incoming,
-        Op2 op_outgoing,
-        Op3 op_node
+    Weight maximize(
+        const Weight* incoming_block,
+        const Weight* outgoing_block,
+        const WeightVector& node_weights,
+        typename Argmax<Weight>::Function argmax
     ) 
     {
-        double total_weight = node_weights[node_index];
-        op_node(node_index);
+        Weight total_weight = node_weights[node_index];
 
         _incoming_selected = -1;
         if (incoming_indices.size() > 0)
         {
-            int max_index = incoming_indices[0u];
-            double max_weight = incoming_weights[max_index];
+            const Weight* block = incoming_block + _incoming_begin;
+            const unsigned best = argmax(block, incoming_indices.size());
 
-            for (unsigned i = 1u ; i < incoming_indices.size() ; ++ i)
-            {
-                unsigned index = incoming_indices[i];
-                double weight = incoming_weights[index];
-                if (weight > max_weight)
-                {
-                    max_weight = weight;
-                    max_index = index;
-                }
-            }
-            total_weight += max_weight;
-            _incoming_selected = max_index;
-            op_incoming(max_index);
+            total_weight += block[best];
+            _incoming_selected = incoming_indices[best];
         }
 
         for (unsigned cluster_index = 0u ; cluster_index < outgoing_indices.size() ; ++ cluster_index)
         {
-            auto const& indices = outgoing_indices[cluster_index];
+            const unsigned begin = _outgoing_begin[cluster_index];
+            const unsigned size = _outgoing_begin[cluster_index + 1] - begin;
             _outgoing_selected[cluster_index] = -1;
 
-            if (indices.size() > 0)
+            if (size > 0)
             {
-                unsigned max_index = 0u;
-                double max_weight = -1.0;
+                const Weight* block = outgoing_block + begin;
+                const unsigned best = (size == 1u ? 0u : argmax(block, size));
 
-                for (unsigned i = 0u ; i < indices.size() ; ++ i)
+                if (block[best] > 0.0)
                 {
-                    int index = indices[i];
-                    double weight = outgoing_weights[index];
-                    if (weight > max_weight)
-                    {
-                        max_weight = weight;
-                        max_index = index;
-                    }
-                }
-
-                if (max_weight > 0.0)
-                {
-                    total_weight += max_weight;
-                    op_outgoing(max_index);
-                    _outgoing_selected[cluster_index] = max_index;
+                    total_weight += block[best];
+                    _outgoing_selected[cluster_index] = outgoing_indices[cluster_index][best];
                 }
             }
         }
 
         return total_weight;
     }
+
+    // call the operators on the argmax of the last call to maximize()
+    template<class Op1, class Op2, class Op3>
+    void apply(
+        Op1 op_incoming,
+        Op2 op_outgoing,
+        Op3 op_node
+    ) const
+    {
+        op_node(node_index);
+
+        if (_incoming_selected >= 0)
+            op_incoming(_incoming_selected);
+
+        for (int index : _outgoing_selected)
+            if (index >= 0)
+                op_outgoing(index);
+    }
 };
 
-struct ClusterDecoder
+template <class Weight>
+struct BasicClusterDecoder
 {
-    std::vector<NodeDecoder> decoders;
+    typedef BasicWeightVector<Weight> WeightVector;
+
+    std::vector<BasicNodeDecoder<Weight>> decoders;
     int index;
     int cluster_size;
 
     // used for problem reduction
-    std::vector<double> _weights_cache;
+    std::vector<Weight> _weights_cache;
     unsigned _max_index_cache;
 
-    ClusterDecoder(const int t_index, const int t_cluster_size, const std::vector<Arc>& arcs, const std::vector<Node> nodes)
+    // index lists of the node decoders, concatenated,
+    // and their weights gathered at each call to solve()
+    std::vector<unsigned> _incoming_arcs;
+    std::vector<unsigned> _outgoing_arcs;
+    WeightVector _incoming_block;
+    WeightVector _outgoing_block;
+    typename Argmax<Weight>::Function _argmax;
+
+    BasicClusterDecoder(const int t_index, const int t_cluster_size, const ArcVector& arcs, const std::vector<Node>& nodes)
         : index(t_index), cluster_size(t_cluster_size)
     {
         std::map<int, int> node_indices;
@@ -221,39 +304,85 @@ struct ClusterDecoder
             if (arc.source == index)
                 decoders.at(node_indices.at(arc.source_node)).outgoing_indices.at(arc.destination).push_back(i);
         }
+
+        for (auto& decoder : decoders)
+        {
+            decoder._incoming_begin = _incoming_arcs.size();
+            _incoming_arcs.insert(std::end(_incoming_arcs), std::begin(decoder.incoming_indices), std::end(decoder.incoming_indices));
+
+            decoder._outgoing_begin.resize(cluster_size + 1);
+            for (int c = 0 ; c < cluster_size ; ++c)
+            {
+                auto const& indices = decoder.outgoing_indices[c];
+                decoder._outgoing_begin[c] = _outgoing_arcs.size();
+                _outgoing_arcs.insert(std::end(_outgoing_arcs), std::begin(indices), std::end(indices));
+            }
+            decoder._outgoing_begin[cluster_size] = _outgoing_arcs.size();
+        }
+        _incoming_block.resize(_incoming_arcs.size());
+        _outgoing_block.resize(_outgoing_arcs.size());
+        _argmax = Argmax<Weight>::best();
     }
 
 
     template<class Op1, class Op2, class Op3>
-    double maximize(
-        const std::vector<double>& incoming_weights, 
-        const std::vector<double>& outgoing_weights,
-        const std::vector<double>& node_weights,
+    Weight maximize(
+        const WeightVector& incoming_weights, 
+        const WeightVector& outgoing_weights,
+        const WeightVector& node_weights,
         Op1 op_incoming,
         Op2 op_outgoing,
         Op3 op_node
     ) 
     {
+        Weight weight = solve(incoming_weights, outgoing_weights, node_weights);
+        apply(op_incoming, op_outgoing, op_node);
+        return weight;
+    }
+
+    // call the operators on the best node of the last call to solve()
+    template<class Op1, class Op2, class Op3>
+    void apply(
+        Op1 op_incoming,
+        Op2 op_outgoing,
+        Op3 op_node
+    ) const
+    {
+        // each node decoder keeps its argmax, no need to recompute it
+        decoders[_max_index_cache].apply(
+                op_incoming,
+                op_outgoing,
+                op_node
+        );
+    }
+
+    Weight solve(
+        const WeightVector& incoming_weights, 
+        const WeightVector& outgoing_weights,
+        const WeightVector& node_weights
+    ) 
+    {
+        for (unsigned k = 0u ; k < _incoming_arcs.size() ; ++k)
+            _incoming_block[k] = incoming_weights[_incoming_arcs[k]];
+        for (unsigned k = 0u ; k < _outgoing_arcs.size() ; ++k)
+            _outgoing_block[k] = outgoing_weights[_outgoing_arcs[k]];
+
         unsigned max_index = 0u;
-        double max_weight = decoders[0u].maximize(
-                incoming_weights,
-                outgoing_weights,
+        Weight max_weight = decoders[0u].maximize(
+                _incoming_block.data(),
+                _outgoing_block.data(),
                 node_weights,
-                [] (int i) { unused_parameter(i); },
-                [] (int i) { unused_parameter(i); },
-                [] (int i) { unused_parameter(i); }
+                _argmax
         );
         _weights_cache[0u] = max_weight;
 
         for (unsigned i = 1u ; i < decoders.size() ; ++i)
         {
-            double weight = decoders[i].maximize(
-                    incoming_weights,
-                    outgoing_weights,
+            Weight weight = decoders[i].maximize(
+                    _incoming_block.data(),
+                    _outgoing_block.data(),
                     node_weights,
-                    [] (int i) { unused_parameter(i); },
-                    [] (int i) { unused_parameter(i); },
-                    [] (int i) { unused_parameter(i); }
+                    _argmax
             );
             _weights_cache[i] = weight;
 
@@ -266,57 +395,93 @@ struct ClusterDecoder
 
         _max_index_cache = max_index;
 
-        // We need to recall the max because of the lambdas
-        return decoders[max_index].maximize(
-                incoming_weights,
-                outgoing_weights,
-                node_weights,
-                op_incoming,
-                op_outgoing,
-                op_node
-        );
+        return max_weight;
     }
 };
-struct DualDecoder
+
+template <class Weight>
+struct BasicDualDecoder
 {
+    typedef BasicWeightVector<Weight> WeightVector;
+
     int cluster_size;
-    CMSADecoder cmsa_decoder;
-    std::vector<ClusterDecoder> cluster_decoders;
+    BasicCMSADecoder<Weight> cmsa_decoder;
+    std::vector<BasicClusterDecoder<Weight>> cluster_decoders;
+
+    // if set, the subproblems are solved concurrently
+    ThreadPool* thread_pool = nullptr;
+    std::vector<Weight> _cluster_weights;
 
-    DualDecoder(const int t_cluster_size, const std::vector<Arc>& arcs, const std::vector<Node>& nodes)
+    BasicDualDecoder(const int t_cluster_size, const ArcVector& arcs, const std::vector<Node>& nodes, MSAAlgorithm msa_algorithm=MSAAlgorithm::lemon)
         : cluster_size(t_cluster_size), 
-          cmsa_decoder(t_cluster_size, arcs)
+          cmsa_decoder(t_cluster_size, arcs, msa_algorithm)
     {
         for (int i = 0 ; i < cluster_size ; ++i)
             //cluster_decoders.emplace_back(i, cluster_size, arcs, nodes);
-            cluster_decoders.push_back(ClusterDecoder(i, cluster_size, arcs, nodes));
+            cluster_decoders.push_back(BasicClusterDecoder<Weight>(i, cluster_size, arcs, nodes));
+        _cluster_weights.resize(cluster_size);
     }
 
     template<class Op1, class Op2, class Op3, class Op4>
-    double maximize(
-        const std::vector<double>& cmsa_weight,
-        const std::vector<double>& incoming_weights, 
-        const std::vector<double>& outgoing_weights,
-        const std::vector<double>& node_weights,
+    Weight maximize(
+        const WeightVector& cmsa_weight,
+        const WeightVector& incoming_weights, 
+        const WeightVector& outgoing_weights,
+        const WeightVector& node_weights,
         Op1 op_cmsa,
         Op2 op_incoming,
         Op3 op_outgoing,
         Op4 op_node
     )
     {
-        double weight = cmsa_decoder.maximize(cmsa_weight, op_cmsa);
+        if (thread_pool == nullptr)
+        {
+            Weight weight = cmsa_decoder.maximize(cmsa_weight, op_cmsa);
+
+            for (auto& decoder : cluster_decoders)
+                weight += decoder.maximize(
+                        incoming_weights,
+                        outgoing_weights,
+                        node_weights,
+                        op_incoming,
+                        op_outgoing,
+                        op_node
+                );
 
-        for (auto& decoder : cluster_decoders)
-            weight += decoder.maximize(
-                    incoming_weights,
-                    outgoing_weights,
-                    node_weights,
-                    op_incoming,
-                    op_outgoing,
-                    op_node
-            );
+            return weight;
+        }
+
+        // task 0 is the CMSA, then one task per cluster
+        Weight weight;
+        thread_pool->run(
+            cluster_size + 1,
+            [&] (const unsigned task)
+            {
+                if (task == 0u)
+                    weight = cmsa_decoder.solve(cmsa_weight);
+                else
+                    _cluster_weights[task - 1u] = cluster_decoders[task - 1u].solve(
+                            incoming_weights,
+                            outgoing_weights,
+                            node_weights
+                    );
+            }
+        );
+
+        // operators are called on this thread in the same order
+        // as the sequential version, so the result is deterministic
+        cmsa_decoder.apply(op_cmsa);
+        for (int i = 0 ; i < cluster_size ; ++i)
+        {
+            cluster_decoders[i].apply(op_incoming, op_outgoing, op_node);
+            weight += _cluster_weights[i];
+        }
 
         return weight;
     }
 };
 
+typedef BasicCMSADecoder<double> CMSADecoder;
+typedef BasicNodeDecoder<double> NodeDecoder;
+typedef BasicClusterDecoder<double> ClusterDecoder;
+typedef BasicDualDecoder<double> DualDecoder;
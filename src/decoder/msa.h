@@ -0,0 +1,654 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <utility>
+#include <algorithm>
+
+#include "utils.h"
+
+// Maximum spanning arborescence (Tarjan's algorithm)
+//
+// The arc set is fixed at construction and the buffers are only allocated
+// at the first call to run(), so the same object can be re-used at each
+// iteration of the subgradient loop where only the weights change.
+//
+// - sparse: incoming arcs of each (contracted) node are kept in a leftist
+//   heap with lazy offsets, O(m log n)
+// - dense: best incoming arc from each (contracted) node is kept in a
+//   n * n matrix, O(n^2)
+//
+// Cycles are expanded using a union-find structure with rollback.
+// Arcs with a non-finite weight are ignored.
+//
+// Incremental mode: the laminar family of contracted cycles and its dual
+// values are kept after a full solve. At the next call, only the arcs whose
+// weight changed are checked against this certificate (the duals of the
+// nodes whose incoming arc changed are shifted so that it stays tight).
+// If no reduced cost becomes negative, the previous arborescence is still
+// optimal and re-used. Otherwise, or if too many weights moved, we fall back
+// to a full solve.
+//
+// Weight is the precision of the arc weights and of all the internal costs.
+template <class Weight>
+struct BasicArborescenceSolver
+{
+    int n_nodes;
+    bool dense;
+
+    bool incremental = false;
+    // maximum ratio of modified weights for a warm start
+    double incremental_threshold = 0.25;
+
+    unsigned n_full_solves = 0u;
+    unsigned n_warm_starts = 0u;
+
+    std::vector<int> sources;
+    std::vector<int> destinations;
+    std::vector<Weight> weights;
+
+    // solution: index of the incoming arc of each node (-1 for the root)
+    std::vector<int> pred;
+    Weight weight;
+
+    // union-find with rollback
+    std::vector<int> _uf;
+    std::vector<std::pair<int, int>> _uf_history;
+
+    // sparse: one heap element per arc
+    std::vector<Weight> _heap_cost;
+    std::vector<Weight> _heap_delta;
+    std::vector<int> _heap_left;
+    std::vector<int> _heap_right;
+    std::vector<int> _heap_rank;
+    std::vector<int> _heap_root;
+
+    // dense: cost & arc index of the best arc between two contracted nodes
+    std::vector<Weight> _matrix_cost;
+    std::vector<int> _matrix_arc;
+    std::vector<Weight> _offset;
+    std::vector<bool> _active;
+
+    std::vector<int> _seen;
+    std::vector<int> _path;
+    std::vector<int> _queue;
+    std::vector<int> _incoming;
+
+    struct Cycle
+    {
+        int node;
+        unsigned time;
+        unsigned begin;
+        unsigned end;
+    };
+    std::vector<Cycle> _cycles;
+    std::vector<int> _cycle_arcs;
+
+    // laminar family: singletons are sets 0..n-1, then contracted cycles
+    int _n_sets;
+    std::vector<int> _set_of_rep;
+    std::vector<int> _set_parent;
+    std::vector<int> _set_depth;
+    std::vector<Weight> _set_y;
+    std::vector<Weight> _set_ysum;
+
+    // certificate of the previous solution
+    bool _has_certificate = false;
+    int _root;
+    std::vector<Weight> _previous_weights;
+    std::vector<Weight> _base;
+    std::vector<int> _in_begin;
+    std::vector<int> _in_arcs;
+    std::vector<int> _changed;
+    std::vector<int> _dirty;
+
+    BasicArborescenceSolver(const int t_n_nodes, const bool t_dense=false)
+        : n_nodes(t_n_nodes), dense(t_dense)
+    {}
+
+    // dense is O(n^2) and sparse is O(m log n)
+    static bool prefer_dense(const unsigned n_nodes, const unsigned n_arcs)
+    {
+        double log_n = std::log2(std::max(n_nodes, 2u));
+        return n_arcs * log_n >= (double) n_nodes * n_nodes;
+    }
+
+    int add_arc(const int source, const int destination)
+    {
+        sources.push_back(source);
+        destinations.push_back(destination);
+        weights.push_back(0.0);
+
+        return sources.size() - 1;
+    }
+
+    bool run(const int root)
+    {
+        _allocate();
+
+        if (incremental)
+        {
+            if (_has_certificate && root == _root && _warm_start())
+            {
+                ++ n_warm_starts;
+                return true;
+            }
+            ++ n_full_solves;
+        }
+        _has_certificate = false;
+
+        if (!_solve(root))
+            return false;
+
+        if (incremental)
+            _build_certificate(root);
+
+        return true;
+    }
+
+    bool _solve(const int root)
+    {
+        std::fill(std::begin(_uf), std::end(_uf), -1);
+        _uf_history.clear();
+        _cycles.clear();
+        _cycle_arcs.clear();
+
+        if (dense)
+            _init_dense(root);
+        else
+            _init_sparse(root);
+
+        std::fill(std::begin(_seen), std::end(_seen), -1);
+        std::fill(std::begin(_incoming), std::end(_incoming), -1);
+        _seen[root] = root;
+
+        _n_sets = n_nodes;
+        for (int v = 0 ; v < n_nodes ; ++v)
+        {
+            _set_of_rep[v] = v;
+            _set_parent[v] = -1;
+        }
+
+        for (int s = 0 ; s < n_nodes ; ++s)
+        {
+            int u = s;
+            unsigned qi = 0u;
+
+            while (_seen[u] < 0)
+            {
+                Weight reduced;
+                int arc = (dense ? _select_dense(u, reduced) : _select_sparse(u, reduced));
+                if (arc < 0)
+                    return false;
+                _set_y[_set_of_rep[u]] = reduced;
+
+                _queue[qi] = arc;
+                _path[qi] = u;
+                ++ qi;
+                _seen[u] = s;
+
+                u = _find(sources[arc]);
+                if (_seen[u] == s)
+                {
+                    // cycle: contract it
+                    unsigned end = qi;
+                    unsigned time = _uf_history.size();
+
+                    unsigned j = qi;
+                    do
+                    {
+                        -- j;
+                        _set_parent[_set_of_rep[_path[j]]] = _n_sets;
+                    }
+                    while (_path[j] != u);
+
+                    if (dense)
+                        _contract_dense(u, qi);
+                    else
+                        _contract_sparse(u, qi);
+
+                    u = _find(u);
+                    _seen[u] = -1;
+
+                    _set_parent[_n_sets] = -1;
+                    _set_of_rep[u] = _n_sets;
+                    ++ _n_sets;
+
+                    _cycles.push_back({u, time, (unsigned) _cycle_arcs.size(), 0u});
+                    _cycle_arcs.insert(std::end(_cycle_arcs), std::begin(_queue) + qi, std::begin(_queue) + end);
+                    _cycles.back().end = _cycle_arcs.size();
+                }
+            }
+
+            for (unsigned i = 0u ; i < qi ; ++i)
+                _incoming[_find(destinations[_queue[i]])] = _queue[i];
+        }
+
+        // expand cycles, last contracted first
+        for (auto it = _cycles.rbegin() ; it != _cycles.rend() ; ++it)
+        {
+            _rollback(it->time);
+
+            int incoming = _incoming[it->node];
+            for (unsigned i = it->begin ; i < it->end ; ++i)
+                _incoming[_find(destinations[_cycle_arcs[i]])] = _cycle_arcs[i];
+            _incoming[_find(destinations[incoming])] = incoming;
+        }
+
+        weight = 0.0;
+        for (int v = 0 ; v < n_nodes ; ++v)
+        {
+            pred[v] = (v == root ? -1 : _incoming[v]);
+            if (v != root)
+                weight += weights[pred[v]];
+        }
+
+        return true;
+    }
+
+    void _allocate()
+    {
+        const unsigned n_arcs = sources.size();
+
+        _uf.resize(n_nodes);
+        _seen.resize(n_nodes);
+        _path.resize(n_nodes);
+        _queue.resize(n_nodes);
+        _incoming.resize(n_nodes);
+        pred.resize(n_nodes);
+
+        _set_of_rep.resize(n_nodes);
+        _set_parent.resize(2 * n_nodes);
+        _set_depth.resize(2 * n_nodes);
+        _set_y.resize(2 * n_nodes);
+        _set_ysum.resize(2 * n_nodes);
+
+        if (incremental && _in_arcs.size() != n_arcs)
+        {
+            _previous_weights.resize(n_arcs);
+            _base.resize(n_arcs);
+
+            // incoming arcs of each node
+            _in_begin.assign(n_nodes + 1, 0);
+            for (unsigned i = 0u ; i < n_arcs ; ++i)
+                ++ _in_begin[destinations[i] + 1];
+            for (int v = 0 ; v < n_nodes ; ++v)
+                _in_begin[v + 1] += _in_begin[v];
+
+            _in_arcs.resize(n_arcs);
+            std::vector<int> position(std::begin(_in_begin), std::end(_in_begin) - 1);
+            for (unsigned i = 0u ; i < n_arcs ; ++i)
+                _in_arcs[position[destinations[i]] ++] = i;
+        }
+
+        if (dense)
+        {
+            _matrix_cost.resize(n_nodes * n_nodes);
+            _matrix_arc.resize(n_nodes * n_nodes);
+            _offset.resize(n_nodes);
+            _active.resize(n_nodes);
+        }
+        else
+        {
+            _heap_cost.resize(n_arcs);
+            _heap_delta.resize(n_arcs);
+            _heap_left.resize(n_arcs);
+            _heap_right.resize(n_arcs);
+            _heap_rank.resize(n_arcs);
+            _heap_root.resize(n_nodes);
+        }
+    }
+
+    // Incremental mode
+
+    void _build_certificate(const int root)
+    {
+        // sum of the duals of the contracted sets containing each set
+        for (int k = _n_sets - 1 ; k >= 0 ; --k)
+        {
+            const int p = _set_parent[k];
+            _set_ysum[k] = (p < 0 ? 0.0 : _set_ysum[p]) + (k >= n_nodes ? _set_y[k] : 0.0);
+            _set_depth[k] = (p < 0 ? 0 : _set_depth[p] + 1);
+        }
+
+        // reduced cost of each arc, without the dual of its destination
+        for (unsigned i = 0u ; i < sources.size() ; ++i)
+        {
+            if (destinations[i] == root || sources[i] == destinations[i] || !std::isfinite(weights[i]))
+            {
+                _base[i] = std::numeric_limits<Weight>::infinity();
+                continue;
+            }
+
+            // smallest contracted set containing both the source and the destination
+            int x = destinations[i];
+            int y = sources[i];
+            while (x != y && x >= 0 && y >= 0)
+            {
+                if (_set_depth[x] > _set_depth[y])
+                    x = _set_parent[x];
+                else if (_set_depth[y] > _set_depth[x])
+                    y = _set_parent[y];
+                else
+                {
+                    x = _set_parent[x];
+                    y = _set_parent[y];
+                }
+            }
+            const Weight outer = (x >= 0 && x == y ? _set_ysum[x] : 0.0);
+
+            _base[i] = - weights[i] - (_set_ysum[destinations[i]] - outer);
+        }
+
+        std::copy(std::begin(weights), std::end(weights), std::begin(_previous_weights));
+        _root = root;
+        _has_certificate = true;
+    }
+
+    bool _warm_start()
+    {
+        const unsigned max_changed = incremental_threshold * weights.size();
+
+        _changed.clear();
+        for (unsigned i = 0u ; i < weights.size() ; ++i)
+        {
+            if (weights[i] != _previous_weights[i])
+            {
+                _changed.push_back(i);
+                if (_changed.size() > max_changed)
+                    return false;
+            }
+        }
+
+        _dirty.clear();
+        for (int i : _changed)
+        {
+            const int d = destinations[i];
+            if (d == _root || sources[i] == d)
+                continue;
+
+            const Weight old_weight = _previous_weights[i];
+            const Weight new_weight = weights[i];
+            if (!std::isfinite(old_weight))
+                return false;
+
+            if (pred[d] == i)
+            {
+                if (!std::isfinite(new_weight))
+                    return false;
+
+                // keep the arc of the solution tight
+                _set_y[d] += old_weight - new_weight;
+                _dirty.push_back(d);
+            }
+            else if (!std::isfinite(new_weight))
+                _base[i] = std::numeric_limits<Weight>::infinity();
+            else
+                _base[i] += old_weight - new_weight;
+        }
+
+        // check that all reduced costs are still non-negative
+        for (int i : _changed)
+        {
+            const int d = destinations[i];
+            if (d != _root && pred[d] != i && _base[i] - _set_y[d] < -TOL_OF(_base[i]))
+                return false;
+        }
+        for (int d : _dirty)
+        {
+            for (int k = _in_begin[d] ; k < _in_begin[d + 1] ; ++k)
+            {
+                const int i = _in_arcs[k];
+                if (pred[d] != i && _base[i] - _set_y[d] < -TOL_OF(_base[i]))
+                    return false;
+            }
+        }
+
+        for (int i : _changed)
+            _previous_weights[i] = weights[i];
+
+        weight = 0.0;
+        for (int v = 0 ; v < n_nodes ; ++v)
+        {
+            if (v != _root)
+                weight += weights[pred[v]];
+        }
+
+        return true;
+    }
+
+    int _find(int x) const
+    {
+        while (_uf[x] >= 0)
+            x = _uf[x];
+        return x;
+    }
+
+    bool _join(int a, int b)
+    {
+        a = _find(a);
+        b = _find(b);
+        if (a == b)
+            return false;
+
+        if (_uf[a] > _uf[b])
+            std::swap(a, b);
+
+        _uf_history.emplace_back(a, _uf[a]);
+        _uf_history.emplace_back(b, _uf[b]);
+        _uf[a] += _uf[b];
+        _uf[b] = a;
+
+        return true;
+    }
+
+    void _rollback(const unsigned time)
+    {
+        while (_uf_history.size() > time)
+        {
+            _uf[_uf_history.back().first] = _uf_history.back().second;
+            _uf_history.pop_back();
+        }
+    }
+
+    // Sparse implementation
+
+    void _init_sparse(const int root)
+    {
+        std::fill(std::begin(_heap_root), std::end(_heap_root), -1);
+        for (unsigned i = 0u ; i < sources.size() ; ++i)
+        {
+            if (destinations[i] == root || sources[i] == destinations[i] || !std::isfinite(weights[i]))
+                continue;
+
+            _heap_cost[i] = -weights[i];
+            _heap_delta[i] = 0.0;
+            _heap_left[i] = -1;
+            _heap_right[i] = -1;
+            _heap_rank[i] = 1;
+
+            _heap_root[destinations[i]] = _merge(_heap_root[destinations[i]], i);
+        }
+    }
+
+    int _rank(const int a) const
+    {
+        return (a < 0 ? 0 : _heap_rank[a]);
+    }
+
+    void _propagate(const int a)
+    {
+        if (_heap_delta[a] == 0.0)
+            return;
+
+        _heap_cost[a] += _heap_delta[a];
+        if (_heap_left[a] >= 0)
+            _heap_delta[_heap_left[a]] += _heap_delta[a];
+        if (_heap_right[a] >= 0)
+            _heap_delta[_heap_right[a]] += _heap_delta[a];
+        _heap_delta[a] = 0.0;
+    }
+
+    int _merge(int a, int b)
+    {
+        if (a < 0)
+            return b;
+        if (b < 0)
+            return a;
+
+        _propagate(a);
+        _propagate(b);
+        if (_heap_cost[b] < _heap_cost[a])
+            std::swap(a, b);
+
+        _heap_right[a] = _merge(_heap_right[a], b);
+        if (_rank(_heap_left[a]) < _rank(_heap_right[a]))
+            std::swap(_heap_left[a], _heap_right[a]);
+        _heap_rank[a] = _rank(_heap_right[a]) + 1;
+
+        return a;
+    }
+
+    void _pop(int& a)
+    {
+        _propagate(a);
+        a = _merge(_heap_left[a], _heap_right[a]);
+    }
+
+    int _select_sparse(const int u, Weight& reduced)
+    {
+        int& heap = _heap_root[u];
+
+        // remove arcs inside the contracted node
+        while (heap >= 0 && _find(sources[heap]) == u)
+            _pop(heap);
+        if (heap < 0)
+            return -1;
+
+        _propagate(heap);
+        int arc = heap;
+        reduced = _heap_cost[arc];
+        _heap_delta[heap] -= reduced;
+        _pop(heap);
+
+        return arc;
+    }
+
+    void _contract_sparse(const int u, unsigned& qi)
+    {
+        int heap = -1;
+        int w;
+        do
+        {
+            w = _path[--qi];
+            heap = _merge(heap, _heap_root[w]);
+        }
+        while (_join(u, w));
+
+        _heap_root[_find(u)] = heap;
+    }
+
+    // Dense implementation
+
+    void _init_dense(const int root)
+    {
+        std::fill(std::begin(_matrix_cost), std::end(_matrix_cost), std::numeric_limits<Weight>::infinity());
+        std::fill(std::begin(_matrix_arc), std::end(_matrix_arc), -1);
+        std::fill(std::begin(_offset), std::end(_offset), 0.0);
+        std::fill(std::begin(_active), std::end(_active), true);
+
+        for (unsigned i = 0u ; i < sources.size() ; ++i)
+        {
+            if (destinations[i] == root || sources[i] == destinations[i] || !std::isfinite(weights[i]))
+                continue;
+
+            const unsigned cell = destinations[i] * n_nodes + sources[i];
+            if (-weights[i] < _matrix_cost[cell])
+            {
+                _matrix_cost[cell] = -weights[i];
+                _matrix_arc[cell] = i;
+            }
+        }
+    }
+
+    int _select_dense(const int u, Weight& reduced)
+    {
+        const unsigned row = u * n_nodes;
+
+        int best = -1;
+        Weight best_cost = std::numeric_limits<Weight>::infinity();
+        for (int x = 0 ; x < n_nodes ; ++x)
+        {
+            if (x == u || !_active[x])
+                continue;
+
+            if (_matrix_cost[row + x] < best_cost)
+            {
+                best_cost = _matrix_cost[row + x];
+                best = x;
+            }
+        }
+        if (best < 0)
+            return -1;
+
+        _offset[u] = best_cost;
+        reduced = best_cost;
+        return _matrix_arc[row + best];
+    }
+
+    void _contract_dense(const int u, unsigned& qi)
+    {
+        const unsigned end = qi;
+        int w;
+        do
+        {
+            w = _path[--qi];
+            _active[w] = false;
+        }
+        while (_join(u, w));
+
+        const int r = _find(u);
+        const unsigned row = r * n_nodes;
+        for (int x = 0 ; x < n_nodes ; ++x)
+        {
+            if (!_active[x])
+                continue;
+
+            // arcs entering the cycle: reduced costs
+            Weight in_cost = std::numeric_limits<Weight>::infinity();
+            int in_arc = -1;
+            // arcs leaving the cycle: same offset for all members
+            Weight out_cost = std::numeric_limits<Weight>::infinity();
+            int out_arc = -1;
+
+            for (unsigned i = qi ; i < end ; ++i)
+            {
+                const int m = _path[i];
+
+                const Weight c = _matrix_cost[m * n_nodes + x] - _offset[m];
+                if (c < in_cost)
+                {
+                    in_cost = c;
+                    in_arc = _matrix_arc[m * n_nodes + x];
+                }
+
+                if (_matrix_cost[x * n_nodes + m] < out_cost)
+                {
+                    out_cost = _matrix_cost[x * n_nodes + m];
+                    out_arc = _matrix_arc[x * n_nodes + m];
+                }
+            }
+
+            _matrix_cost[row + x] = in_cost;
+            _matrix_arc[row + x] = in_arc;
+            _matrix_cost[x * n_nodes + r] = out_cost;
+            _matrix_arc[x * n_nodes + r] = out_arc;
+        }
+
+        _offset[r] = 0.0;
+        _active[r] = true;
+    }
+};
+
+typedef BasicArborescenceSolver<double> ArborescenceSolver;
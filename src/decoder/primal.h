@@ -1,17 +1,77 @@
 #pragma once
 
-struct PrimalDecoder
+#include <vector>
+#include <unordered_map>
+#include <boost/functional/hash.hpp>
+
+template <class Weight>
+struct BasicPrimalDecoder
 {
-    Status& status;
+    // primal solution for a given node selection:
+    // weight and arborescence
+    struct Solution
+    {
+        bool feasible;
+        Weight weight;
+        std::vector<unsigned> arcs;
+    };
 
-    PrimalDecoder(Status& t_status)
+    struct SelectionHash
+    {
+        std::size_t operator()(const std::vector<int>& selected_nodes) const
+        {
+            return boost::hash_range(std::begin(selected_nodes), std::end(selected_nodes));
+        }
+    };
+
+    BasicStatus<Weight>& status;
+
+    // the weights of the primal problem never change (reduction only
+    // removes nodes, which can't be selected afterwards),
+    // so the solution only depends on the selected nodes
+    std::unordered_map<std::vector<int>, Solution, SelectionHash> cache;
+    unsigned n_cache_hits = 0u;
+    unsigned n_cache_misses = 0u;
+
+    BasicPrimalDecoder(BasicStatus<Weight>& t_status)
         : status(t_status)
     {}
 
     bool update()
     {
-        // TODO: check if the slected nodes have changed
-        double new_weight = 0.0;
+        auto it = cache.find(status.selected_nodes);
+        if (it != std::end(cache))
+        {
+            ++ n_cache_hits;
+        }
+        else
+        {
+            ++ n_cache_misses;
+            it = cache.emplace(status.selected_nodes, solve()).first;
+        }
+
+        const Solution& solution = it->second;
+        if (!solution.feasible)
+            return false;
+
+        if (STRICTLY_SUP(solution.weight, status.primal_weight))
+        {
+            status.primal_weight = solution.weight;
+            status.erase_primal_solution();
+
+            for (unsigned i : solution.arcs)
+                status.primal_arcs[i] = true;
+
+            return true;
+        }
+
+        return false;
+    }
+
+    Solution solve() const
+    {
+        Solution solution;
+        Weight new_weight = 0.0;
 
         LDigraph lemon_graph;
         LArcMap lemon_weights(lemon_graph);
@@ -31,29 +91,30 @@ struct PrimalDecoder
         //std::cout << "pos score: " << new_weight << std::endl;
 
 
-        // TODO: this vector seems useless to me...
-        std::vector<LArc> lemon_arcs;
+        // only arcs between selected nodes
         std::vector<unsigned> arc_indices;
-        for (unsigned i = 0 ; i < status.arcs.size() ; ++i)
+        for (unsigned source = 0 ; source < status.selected_nodes.size() ; ++source)
         {
-            auto const& arc = status.arcs.at(i);
-            if (
-                    status.nodes.at(status.selected_nodes.at(arc.source)).node != arc.source_node 
-                    || 
-                    status.nodes.at(status.selected_nodes.at(arc.destination)).node != arc.destination_node
-            )
-                continue;
-
-
-            LArc lemon_arc = lemon_graph.addArc(
-                lemon_nodes.at(arc.source),
-                lemon_nodes.at(arc.destination)
-            );
-            arc_indices.push_back(i);
-
-            lemon_weights[lemon_arc] = -status.original_weights.at(i);
-            lemon_arcs.push_back(lemon_arc);
-            //std::cout << arc << "\t" << status.original_weights.at(i) << std::endl;
+            for (unsigned destination = 1 ; destination < status.selected_nodes.size() ; ++destination)
+            {
+                if (source == destination)
+                    continue;
+
+                status.for_each_arc(
+                    status.selected_nodes.at(source),
+                    status.selected_nodes.at(destination),
+                    [&] (const unsigned i)
+                    {
+                        LArc lemon_arc = lemon_graph.addArc(
+                            lemon_nodes.at(source),
+                            lemon_nodes.at(destination)
+                        );
+                        arc_indices.push_back(i);
+
+                        lemon_weights[lemon_arc] = -status.original_weights.at(i);
+                    }
+                );
+            }
         }
 
         MSA msa(lemon_graph, lemon_weights);
@@ -70,25 +131,22 @@ struct PrimalDecoder
             auto msa_pred = msa.pred(lemon_graph.nodeFromId(i));
             if (msa_pred == lemon::INVALID)
             {
-                return false;
+                solution.feasible = false;
+                solution.weight = -std::numeric_limits<Weight>::infinity();
+                return solution;
             }
         }
 
-        if (STRICTLY_SUP(new_weight, status.primal_weight))
+        solution.feasible = true;
+        solution.weight = new_weight;
+        for (unsigned i = 1 ; i < status.selected_nodes.size() ; ++i)
         {
-            status.primal_weight = new_weight;
-            status.erase_primal_solution();
-
-            for (unsigned i = 1 ; i < status.selected_nodes.size() ; ++i)
-            {
-                auto msa_pred = msa.pred(lemon_graph.nodeFromId(i));
-                status.primal_arcs[arc_indices[lemon_graph.id(msa_pred)]] = true;
-            }
-
-            return true;
+            auto msa_pred = msa.pred(lemon_graph.nodeFromId(i));
+            solution.arcs.push_back(arc_indices[lemon_graph.id(msa_pred)]);
         }
 
-        return false;
+        return solution;
     }
 };
 
+typedef BasicPrimalDecoder<double> PrimalDecoder;
@@ -48,6 +48,11 @@ int main(int argc, char **argv)
     bool use_reduction;
     bool arc_weight_heuristic;
     unsigned max_iteration;
+    MSAAlgorithmOption msa_algorithm;
+    DualOptimizerOption dual_optimizer;
+    DecoderOptions decoder_options;
+    unsigned dual_threads;
+    unsigned threads;
     double att_weight = 1.0;
 
     namespace po = boost::program_options;
@@ -59,6 +64,20 @@ int main(int argc, char **argv)
         ("reduction", po::value<bool>(&use_reduction)->default_value(false), "")
         ("arc-weight-heuristic", po::value<bool>(&arc_weight_heuristic)->default_value(false), "")
         ("att-weight", po::value<double>(&att_weight)->default_value(1.0), "")
+        ("msa", po::value<MSAAlgorithmOption>(&msa_algorithm), "MSA algorithm: lemon (default), sparse, dense or auto")
+        ("incremental-msa", po::value<bool>(&decoder_options.incremental_msa)->default_value(false), "MSA: warm start from the previous iteration (native algorithms only)")
+        ("incremental-msa-threshold", po::value<double>(&decoder_options.incremental_msa_threshold)->default_value(0.25), "MSA: full solve if more than this ratio of weights changed")
+        ("compaction-threshold", po::value<double>(&decoder_options.compaction_threshold)->default_value(0.0), "with reduction, compact the problem when the ratio of remaining arcs is below this value (0 to disable)")
+        ("reduction-incoming", po::value<bool>(&decoder_options.reduction_incoming)->default_value(false), "reduction: also remove incoming arcs")
+        ("reduction-outgoing", po::value<bool>(&decoder_options.reduction_outgoing)->default_value(false), "reduction: also remove outgoing arcs")
+        ("adaptive-reduction", po::value<bool>(&decoder_options.adaptive_reduction)->default_value(false), "reduction: schedule the passes from the duality gap and the number of removed elements")
+        ("reduction-max-interval", po::value<unsigned>(&decoder_options.reduction_max_interval)->default_value(16u), "reduction: maximum number of iterations between two passes with adaptive scheduling")
+        ("gap-tolerance", po::value<double>(&decoder_options.gap_tolerance)->default_value(0.0), "stop when the duality gap is below this value (0 to disable)")
+        ("relative-gap-tolerance", po::value<double>(&decoder_options.relative_gap_tolerance)->default_value(0.0), "stop when the duality gap is below this ratio of the dual value (0 to disable)")
+        ("time-budget-ms", po::value<double>(&decoder_options.time_budget_ms)->default_value(0.0), "maximum decoding time per sentence in milliseconds, the best primal is returned (0 to disable)")
+        ("threads", po::value<unsigned>(&threads)->default_value(1u), "number of sentences decoded in parallel")
+        ("dual-threads", po::value<unsigned>(&dual_threads)->default_value(1u), "number of threads used to solve the dual subproblems of a sentence")
+        ("dual-threads-min-length", po::value<unsigned>(&decoder_options.parallel_min_length)->default_value(30u), "minimum sentence length for using more than one thread in the dual")
         // SGD options
         ("max-iteration", po::value<unsigned>(&max_iteration)->default_value(500), "")
         ("stepsize-scale", po::value<double>(&stepsize_options.stepsize_scale)->default_value(1.0), "SGD: stepsize scale")
@@ -68,6 +87,9 @@ int main(int argc, char **argv)
         ("constant-decreasing", po::value<bool>(&stepsize_options.constant_decreasing)->default_value(false), "SGD: decrease stepsize at each iteration")
         ("camerini", po::value<bool>(&stepsize_options.camerini)->default_value(false), "SGD: use Camerini et al. momentum subgradient")
         ("gamma", po::value<double>(&stepsize_options.gamma)->default_value(1.5), "SGD: gamma paremeter for Camerini et al. momentum subgradient")
+        ("sparse-subgradient", po::value<bool>(&stepsize_options.sparse)->default_value(false), "SGD: only visit the arcs in the support of the subgradient")
+        ("single-precision", po::value<bool>(&decoder_options.single_precision)->default_value(false), "decode with single precision (float) weights")
+        ("dual-optimizer", po::value<DualOptimizerOption>(&dual_optimizer), "SGD: dual optimizer: subgradient or nesterov")
     ;
 
     po::positional_options_description pod; 
@@ -81,6 +103,20 @@ int main(int argc, char **argv)
 
     dynet::initialize(argc, argv);
 
+    decoder_options.msa_algorithm = msa_algorithm.value;
+    stepsize_options.optimizer = dual_optimizer.value;
+
+    if (threads > 1u && dual_threads > 1u)
+    {
+        std::cerr << "Warning: --dual-threads is ignored when --threads > 1" << std::endl;
+        dual_threads = 1u;
+    }
+
+    ThreadPool sentence_thread_pool(threads);
+    ThreadPool dual_thread_pool(dual_threads);
+    if (dual_threads > 1u)
+        decoder_options.thread_pool = &dual_thread_pool;
+
     SpineSettings spine_settings;
     read_object(model_path + ".conll_settings.param", conll_settings);
     
@@ -124,10 +160,18 @@ int main(int argc, char **argv)
     for (unsigned i = 0u ; i < conll_settings.pos_dict.size() ; ++i)
         allowed_pos.at(word_unknown).insert(i);
 
+    // network scoring is sequential (dynet graphs and builders can't be
+    // shared between threads), decoding is done by chunk of sentences,
+    // each sentence being decoded by a single thread
+    const unsigned chunk_size = (threads > 1u ? 8u * threads : 1u);
+    std::vector<IntSentence*> pending_sentences;
+    std::vector<Status> pending_status;
+    std::vector<DecoderTimer> pending_timers;
+    DecoderTimer total_timer;
+
     for (IntSentence& sentence : test_data)
     {
         Timer creation_timer;
-        Timer solver_timer;
 
         creation_timer.start();
         Status status;
@@ -167,13 +211,11 @@ int main(int argc, char **argv)
         // Compute arc scores
         {
             dynet::ComputationGraph cg;
-            parser_nn.compute(
+            parser_nn.compute_scores(
                 cg,
                 sentence,
-                [&] (const unsigned head, const unsigned modifier, const double score, dynet::expr::Expression& expr) -> void
+                [&] (const unsigned head, const unsigned modifier, const double score) -> void
                 {
-                    unused_parameter(expr);
-
                     if (head == 0u)
                     {
                         for (auto mod_pos : allowed_pos.at(sentence[modifier].word))
@@ -251,30 +293,53 @@ int main(int argc, char **argv)
             }
         }
         creation_timer.stop();
-        solver_timer.start();
+
+        pending_sentences.push_back(&sentence);
+        pending_status.push_back(std::move(status));
+        if (pending_status.size() < chunk_size && &sentence != &test_data.back())
+            continue;
 
         // decode
-        DecoderTimer decoder_timer;
-        decode_primal(
-            status,
-            stepsize_options,
-            max_iteration,
-            use_reduction,
-            [&] (int index, int pos) {
-                if (index != 0)
-                    sentence[index].pos = pos;
-            },
-            [&] (int index, int head) {
-                sentence[index].head = head;
-            },
-            decoder_timer
+        pending_timers.assign(pending_status.size(), DecoderTimer());
+        sentence_thread_pool.run(
+            pending_status.size(),
+            [&] (unsigned k)
+            {
+                IntSentence& pending_sentence = *pending_sentences.at(k);
+
+                Timer solver_timer;
+                solver_timer.start();
+                DecoderTimer& decoder_timer = pending_timers.at(k);
+                decode_primal_with_precision(
+                    pending_status.at(k),
+                    stepsize_options,
+                    max_iteration,
+                    use_reduction,
+                    decoder_options,
+                    [&] (int index, int pos) {
+                        if (index != 0)
+                            pending_sentence[index].pos = pos;
+                    },
+                    [&] (int index, int head) {
+                        pending_sentence[index].head = head;
+                    },
+                    decoder_timer
+                );
+                solver_timer.stop();
+
+                //std::cout << solver_timer.milliseconds() << "\t" << pending_sentence.size() << std::endl << std::flush;
+            }
         );
-        solver_timer.stop();
 
-        //std::cout << creation_timer.milliseconds() << "\t" << solver_timer.milliseconds() << "\t" << sentence.size() << std::endl << std::flush;
-        //std::cout << decoder_timer << std::endl;
+        // statistics in sentence order
+        for (auto const& decoder_timer : pending_timers)
+        {
+            write_sentence_stats(std::cout, decoder_timer);
+            total_timer.add(decoder_timer);
+        }
 
-        //std::cout << "Converged: " << converged << std::endl;
+        pending_sentences.clear();
+        pending_status.clear();
     } // end for sentence
 
 
@@ -304,6 +369,10 @@ int main(int argc, char **argv)
         }
     }
 
+    std::cerr << "Decoder statistics:" << std::endl;
+    write_decoder_timer_header(std::cerr) << std::endl;
+    std::cerr << total_timer << std::endl;
+
     std::ofstream f(output_path);
     f << conll_test;
     f.close();
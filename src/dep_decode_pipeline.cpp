@@ -134,13 +134,11 @@ int main(int argc, char **argv)
                 assert(lemon_graph.id(node) == (int) i);
             }
 
-            rnn.compute(
+            rnn.compute_scores(
                 cg,
                 sentence,
-                [&] (const unsigned head, const unsigned modifier, double score, dynet::expr::Expression& expr) -> void
+                [&] (const unsigned head, const unsigned modifier, double score) -> void
                 {
-                    unused_parameter(expr);
-
                     int mod_pos = sentence[modifier].pos;
 
 
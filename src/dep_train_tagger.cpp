@@ -7,6 +7,7 @@
 #include <utility>
 #include <stdexcept>
 #include <cmath>
+#include <cstdlib>
 #include <chrono>
 #include <boost/filesystem.hpp>
 
@@ -22,6 +23,8 @@
 #include "serialization.h"
 #include "nn/tagger.h"
 #include "utils.h"
+#include "batch.h"
+#include "parallel_training.h"
 
 #include "dependency.h"
 #include "conll.h"
@@ -35,6 +38,9 @@ int main(int argc, char **argv)
     std::string dev_path;
     std::string model_path;
     unsigned n_iteration;
+    unsigned batch_size;
+    unsigned seed;
+    unsigned workers;
 
     bool probabilistic;
 
@@ -45,6 +51,7 @@ int main(int argc, char **argv)
 
     std::string ignore_dynet_mem;
     std::string ignore_dynet_wd;
+    std::string ignore_dynet_seed;
 
     unsigned n_stack;
     unsigned n_layer;
@@ -59,6 +66,9 @@ int main(int argc, char **argv)
         ("train", po::value<std::string>(&train_path)->required(), "")
         ("model", po::value<std::string>(&model_path)->required(), "")
         ("iteration", po::value<unsigned>(&n_iteration)->default_value(20), "")
+        ("batch-size", po::value<unsigned>(&batch_size)->default_value(1u), "number of sentences per update, batches are grouped by sentence length")
+        ("seed", po::value<unsigned>(&seed), "seed of the sentence order and word dropout (use --dynet-seed for the parameter initialization)")
+        ("workers", po::value<unsigned>(&workers)->default_value(1u), "number of training processes, their parameters are averaged after each epoch")
         ("eval-on-dev", po::value<bool>(&eval_on_dev)->default_value(false), "")
         ("dev-path", po::value<std::string>(&dev_path)->default_value(""), "")
         // dropout
@@ -67,6 +77,7 @@ int main(int argc, char **argv)
         // dynet
         ("dynet-mem", po::value<std::string>(&ignore_dynet_mem), "")
         ("dynet-weight-decay", po::value<std::string>(&ignore_dynet_wd), "")
+        ("dynet-seed", po::value<std::string>(&ignore_dynet_seed), "")
         // nn options
         ("activation-function", po::value<ActivationFunctionOption>(&activation_function), "") 
         ("lstm-dim", po::value<int>(&lstm_dim)->default_value(125))
@@ -86,6 +97,9 @@ int main(int argc, char **argv)
 
     dynet::initialize(argc, argv);
 
+    if (vm.count("seed"))
+        srand(seed);
+
     ConllSettings conll_settings;
     read_object(model_path + ".conll_settings.param", conll_settings);
     
@@ -148,68 +162,83 @@ int main(int argc, char **argv)
         unsigned n_correct = 0;
         unsigned n_total = 0;
         
-        std::random_shuffle(std::begin(train_data), std::end(train_data));
-
-        for (const IntSentence& sentence : train_data)
-        {
-            dynet::ComputationGraph cg;
-
-            // loss output
-            std::vector<Expression> errs;
-            
-            rnn.compute(
-                cg,
-                sentence,
-                [&] (unsigned index, dynet::expr::Expression& expr) -> void
-                {
-                    if (probabilistic)
-                    {
-                        errs.push_back(pickneglogsoftmax(expr, sentence[index+1].pos));
+        EpochStats epoch_stats;
+        run_parallel_epoch(
+            model,
+            make_batches(train_data, batch_size),
+            workers,
+            model_path,
+            epoch_stats,
+            [&] (const std::vector<unsigned>& batch, EpochStats& stats)
+            {
+                // one graph and one update for all the sentences of the batch
+                dynet::ComputationGraph cg;
 
-                        auto vec = dynet::as_vector(expr.value());
-                        int predicted = std::distance(std::begin(vec), std::max_element(std::begin(vec), std::end(vec)));
-                        if (predicted == sentence[index+1].pos)
-                            n_correct += 1;
-                    }
-                    else
-                    {
-                        dynet::expr::Expression expr2 = tanh(expr);
-                        auto vec = dynet::as_vector(expr2.value());
+                // loss output
+                std::vector<Expression> errs;
 
-                        // loss augmented inference
-                        for (unsigned i = 0u ; i < vec.size() ; ++i)
-                        {
-                            if ((int) i != sentence[index+1].pos)
-                                vec[i] += 1.0;
-                        }
+                for (const unsigned sentence_index : batch)
+                {
+                    const IntSentence& sentence = train_data.at(sentence_index);
 
-                        int predicted = std::distance(std::begin(vec), std::max_element(std::begin(vec), std::end(vec)));
-                        if (predicted == sentence[index+1].pos)
+                    rnn.compute(
+                        cg,
+                        sentence,
+                        [&] (unsigned index, dynet::expr::Expression& expr) -> void
                         {
-                            n_correct += 1;
-                        }
-                        else
-                        {
-                            errs.push_back(dynet::expr::pick(expr2, predicted) - pick(expr2, sentence[index+1].pos));
-                        }
-                    }
-                },
-                true, // word dropout
-                dropout,
-                dropout_p
-            );
-
-            n_total += sentence.size();
-
-            // backprop
-            if (errs.size() > 0)
-            {
-                Expression sum_errs = dynet::expr::sum(errs);
-                loss += as_scalar(cg.get_value(sum_errs.i));
-                cg.backward(sum_errs.i);
-                trainer.update(1.0);
+                            if (probabilistic)
+                            {
+                                errs.push_back(pickneglogsoftmax(expr, sentence[index+1].pos));
+
+                                auto vec = dynet::as_vector(expr.value());
+                                int predicted = std::distance(std::begin(vec), std::max_element(std::begin(vec), std::end(vec)));
+                                if (predicted == sentence[index+1].pos)
+                                    stats.n_correct += 1;
+                            }
+                            else
+                            {
+                                dynet::expr::Expression expr2 = tanh(expr);
+                                auto vec = dynet::as_vector(expr2.value());
+
+                                // loss augmented inference
+                                for (unsigned i = 0u ; i < vec.size() ; ++i)
+                                {
+                                    if ((int) i != sentence[index+1].pos)
+                                        vec[i] += 1.0;
+                                }
+
+                                int predicted = std::distance(std::begin(vec), std::max_element(std::begin(vec), std::end(vec)));
+                                if (predicted == sentence[index+1].pos)
+                                {
+                                    stats.n_correct += 1;
+                                }
+                                else
+                                {
+                                    errs.push_back(dynet::expr::pick(expr2, predicted) - pick(expr2, sentence[index+1].pos));
+                                }
+                            }
+                        },
+                        true, // word dropout
+                        dropout,
+                        dropout_p
+                    );
+
+                    stats.n_total += sentence.size();
+                }
+
+                // backprop
+                if (errs.size() > 0)
+                {
+                    Expression sum_errs = dynet::expr::sum(errs);
+                    stats.loss += as_scalar(cg.get_value(sum_errs.i));
+                    cg.backward(sum_errs.i);
+                    trainer.update(1.0);
+                }
             }
-        }
+        );
+        loss += epoch_stats.loss;
+        n_correct += epoch_stats.n_correct;
+        n_total += epoch_stats.n_total;
 
         trainer.update_epoch();
         trainer.status();
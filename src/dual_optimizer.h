@@ -0,0 +1,41 @@
+#pragma once
+
+#include <boost/program_options.hpp>
+
+// Method used to update the Lagrange multipliers from the subgradient
+// - subgradient: projected subgradient step
+// - nesterov: subgradient step at an extrapolated point (Nesterov
+//   momentum), restarted each time the dual value increases
+enum struct DualOptimizer { subgradient, nesterov };
+struct DualOptimizerOption{
+    DualOptimizer value;
+
+    DualOptimizerOption(std::string const& val)
+    {
+        if (val == "subgradient")
+          value = DualOptimizer::subgradient;
+        else if (val == "nesterov")
+          value = DualOptimizer::nesterov;
+    }
+
+    DualOptimizerOption(): value(DualOptimizer::subgradient)
+    {}
+};
+
+void validate(boost::any& v,
+              std::vector<std::string> const& values,
+              DualOptimizerOption* /* target_type */,
+              int)
+{
+  using namespace boost::program_options;
+
+  validators::check_first_occurrence(v);
+
+  std::string const& s = validators::get_single_string(values);
+
+  if (s == "subgradient" || s == "nesterov") {
+    v = boost::any(DualOptimizerOption(s));
+  } else {
+    throw validation_error(validation_error::invalid_option_value);
+  }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <boost/program_options.hpp>
+
+// Algorithm used for the maximum spanning arborescence subproblem
+// - lemon: lemon::MinCostArborescence
+// - sparse/dense: native implementation (see decoder/msa.h)
+// - automatic: native, dense or sparse depending on the arc/cluster ratio
+enum struct MSAAlgorithm { lemon, sparse, dense, automatic };
+struct MSAAlgorithmOption{
+    MSAAlgorithm value;
+
+    MSAAlgorithmOption(std::string const& val)
+    {
+        if (val == "lemon")
+          value = MSAAlgorithm::lemon;
+        else if (val == "sparse")
+          value = MSAAlgorithm::sparse;
+        else if (val == "dense")
+          value = MSAAlgorithm::dense;
+        else if (val == "auto")
+          value = MSAAlgorithm::automatic;
+    }
+
+    MSAAlgorithmOption(): value(MSAAlgorithm::lemon)
+    {}
+};
+
+void validate(boost::any& v,
+              std::vector<std::string> const& values,
+              MSAAlgorithmOption* /* target_type */,
+              int)
+{
+  using namespace boost::program_options;
+
+  validators::check_first_occurrence(v);
+
+  std::string const& s = validators::get_single_string(values);
+
+  if (s == "lemon" || s == "sparse" || s == "dense" || s == "auto") {
+    v = boost::any(MSAAlgorithmOption(s));
+  } else {
+    throw validation_error(validation_error::invalid_option_value);
+  }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+#include <cstddef>
+
+#include "status.h"
+
+// Lagrange multipliers of the last decoding of each training sentence,
+// used to warm start the decoding at the next epoch.
+// As cmsa + incoming + outgoing weights is constant, only the offsets of
+// the cmsa and incoming weights from their mean are stored, as floats.
+// Least recently used entries are evicted above max_bytes.
+struct MultiplierCache
+{
+    struct Entry
+    {
+        unsigned id;
+        std::vector<float> cmsa_offsets;
+        std::vector<float> incoming_offsets;
+
+        std::size_t bytes() const
+        {
+            return sizeof(Entry) + (cmsa_offsets.size() + incoming_offsets.size()) * sizeof(float);
+        }
+    };
+
+    std::size_t max_bytes;
+    std::size_t n_bytes = 0u;
+
+    // most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<unsigned, std::list<Entry>::iterator> index;
+
+    unsigned n_hits = 0u;
+    unsigned n_misses = 0u;
+    unsigned n_evictions = 0u;
+
+    explicit MultiplierCache(const std::size_t t_max_bytes)
+        : max_bytes(t_max_bytes)
+    {}
+
+    // apply the cached offsets to the initial weights of the sentence,
+    // return false if there is no usable entry
+    bool restore(const unsigned id, Status& status)
+    {
+        auto it = index.find(id);
+        if (it == std::end(index) || it->second->cmsa_offsets.size() != status.arcs.size())
+        {
+            ++ n_misses;
+            return false;
+        }
+        ++ n_hits;
+
+        entries.splice(std::begin(entries), entries, it->second);
+        const Entry& entry = *it->second;
+
+        for (unsigned i = 0u ; i < status.arcs.size() ; ++i)
+        {
+            const double cmsa_offset = entry.cmsa_offsets[i];
+            const double incoming_offset = entry.incoming_offsets[i];
+
+            status.cmsa_weights[i] += cmsa_offset;
+            status.incoming_weights[i] += incoming_offset;
+            status.outgoing_weights[i] -= cmsa_offset + incoming_offset;
+        }
+
+        return true;
+    }
+
+    // save the weights at the end of the decoding of the sentence
+    void save(const unsigned id, const Status& status)
+    {
+        if (max_bytes == 0u)
+            return;
+
+        Entry entry;
+        entry.id = id;
+        entry.cmsa_offsets.resize(status.arcs.size(), 0.0f);
+        entry.incoming_offsets.resize(status.arcs.size(), 0.0f);
+        for (unsigned i = 0u ; i < status.arcs.size() ; ++i)
+        {
+            const double mean = (status.cmsa_weights[i] + status.incoming_weights[i] + status.outgoing_weights[i]) / 3.0;
+
+            // arcs removed by the reduction
+            if (!std::isfinite(mean))
+                continue;
+
+            entry.cmsa_offsets[i] = status.cmsa_weights[i] - mean;
+            entry.incoming_offsets[i] = status.incoming_weights[i] - mean;
+        }
+
+        if (entry.bytes() > max_bytes)
+            return;
+
+        _erase(id);
+        n_bytes += entry.bytes();
+        entries.push_front(std::move(entry));
+        index[id] = std::begin(entries);
+
+        while (n_bytes > max_bytes)
+        {
+            _erase(entries.back().id);
+            ++ n_evictions;
+        }
+    }
+
+    void _erase(const unsigned id)
+    {
+        auto it = index.find(id);
+        if (it == std::end(index))
+            return;
+
+        n_bytes -= it->second->bytes();
+        entries.erase(it->second);
+        index.erase(it);
+    }
+};
@@ -39,8 +39,56 @@ struct NNArc
         p_pos_correlation = model.add_parameters({n_pos, n_pos});
     }
 
+    // Scores of the arcs of a sentence, read from a single forward pass of
+    // the word pair MLP and of the pos correlation matrix.
+    // Expressions are only built on demand
+    struct Scores
+    {
+        unsigned n_words = 0u;
+        unsigned n_pos = 0u;
+
+        // (head * n_words + modifier) -> row of pair_outputs, -1 if no arc
+        std::vector<int> pair_index;
+        // n_pairs x 1
+        dynet::expr::Expression pair_outputs;
+        // n_pos x n_pos
+        dynet::expr::Expression pos_correlation;
+
+        std::vector<float> pair_values;
+        // column-major
+        std::vector<float> correlation_values;
+
+        template<class Arc>
+        unsigned pair(const Arc& arc) const
+        {
+            return pair_index.at(arc.source * n_words + arc.destination);
+        }
+
+        template<class Arc>
+        double score(const Arc& arc) const
+        {
+            return
+                pair_values.at(pair(arc))
+                +
+                correlation_values.at(arc.destination_node * n_pos + arc.source_node)
+            ;
+        }
+
+        // creates new nodes in the graph
+        template<class Arc>
+        dynet::expr::Expression expr(const Arc& arc) const
+        {
+            return
+                dynet::expr::pick(pair_outputs, pair(arc))
+                +
+                dynet::expr::pick(dynet::expr::pick(pos_correlation, arc.source_node), arc.destination_node)
+            ;
+        }
+    };
+
+    // call op(arc, score) for each arc
     template<class ArcContainer, class Op>
-    void compute(dynet::ComputationGraph& cg, const ArcContainer& arcs, Op op, std::vector<dynet::expr::Expression>& word_embeddings)
+    Scores compute(dynet::ComputationGraph& cg, const ArcContainer& arcs, Op op, std::vector<dynet::expr::Expression>& word_embeddings)
     {
         dynet::expr::Expression e_hidden_layer_head_word = parameter(cg, p_hidden_layer_head_word);
         //dynet::expr::Expression e_hidden_layer_head_pos = parameter(cg, p_hidden_layer_head_pos);
@@ -53,14 +101,10 @@ struct NNArc
 
         dynet::expr::Expression e_pos_correlation = parameter(cg, p_pos_correlation);
 
-        // Cache common operations
-        std::vector<dynet::expr::Expression> cache_head_word;
-        std::vector<dynet::expr::Expression> cache_mod_word;
-        for (unsigned int i = 0 ; i < word_embeddings.size() ; ++i)
-        {
-            cache_head_word.push_back(e_hidden_layer_head_word * word_embeddings.at(i));
-            cache_mod_word.push_back(e_hidden_layer_mod_word * word_embeddings.at(i));
-        }
+        // Cache common operations, one column per word
+        dynet::expr::Expression words = dynet::expr::concatenate_cols(word_embeddings);
+        dynet::expr::Expression cache_head_word = e_hidden_layer_head_word * words;
+        dynet::expr::Expression cache_mod_word = e_hidden_layer_mod_word * words;
 
         /*
         std::vector<dynet::expr::Expression> cache_head_pos;
@@ -72,37 +116,55 @@ struct NNArc
         }
         */
 
+        // The MLP only depends on the (head, modifier) words:
+        // compute it once per word pair, for all pairs in one batch
+        Scores scores;
+        scores.n_words = word_embeddings.size();
+        scores.n_pos = n_pos;
+        scores.pos_correlation = e_pos_correlation;
+        scores.pair_index.assign(scores.n_words * scores.n_words, -1);
 
+        std::vector<unsigned> pair_heads;
+        std::vector<unsigned> pair_mods;
         for (auto const& arc : arcs)
         {
-            auto const head = arc.source;
-            //auto const head_pos = arc.source_node;
-            auto const modifier = arc.destination;
-            //auto const modifier_pos = arc.destination_node;
+            int& index = scores.pair_index.at(arc.source * scores.n_words + arc.destination);
+            if (index < 0)
+            {
+                index = pair_heads.size();
+                pair_heads.push_back(arc.source);
+                pair_mods.push_back(arc.destination);
+            }
+        }
+
+        if (pair_heads.size() == 0u)
+            return scores;
 
+        const unsigned n_pairs = pair_heads.size();
+        dynet::expr::Expression ones = dynet::expr::input(cg, {1u, n_pairs}, std::vector<float>(n_pairs, 1.f));
 
-            dynet::expr::Expression output = 
+        scores.pair_outputs = 
+            dynet::expr::transpose(
                 e_output_layer
                 *
                 dynet::expr::tanh(
-                    cache_head_word.at(head)
-                    //+
-                    //cache_head_pos.at(head_pos)
+                    dynet::expr::select_cols(cache_head_word, pair_heads)
                     + 
-                    cache_mod_word.at(modifier)
-                    //+
-                    //cache_mod_pos.at(modifier_pos)
+                    dynet::expr::select_cols(cache_mod_word, pair_mods)
                     + 
-                    e_hidden_bias
+                    e_hidden_bias * ones
                 )
-                +
-                // Will probably not compile...
-                pick(pick(e_pos_correlation, arc.source_node), arc.destination_node)
-            ;
+            )
+        ;
 
-            auto score = as_scalar(cg.get_value(output.i));
-            op(arc, score, output);
-        }
+        // one forward for all the pairs, arc scores are read from the values
+        scores.pair_values = dynet::as_vector(cg.get_value(scores.pair_outputs.i));
+        scores.correlation_values = dynet::as_vector(cg.get_value(e_pos_correlation.i));
+
+        for (auto const& arc : arcs)
+            op(arc, scores.score(arc));
+
+        return scores;
     }
 };
 
@@ -86,6 +86,65 @@ struct NeuralBiaffineParser
             lp_pos = model.add_lookup_parameters(settings.n_pos, {settings.pos_dim});
     }
 
+    // Scores of all the arcs of a sentence, computed as one matrix:
+    // row h, column m - 1 is the score of the arc from head h to modifier m
+    struct Scores
+    {
+        unsigned n_heads;
+        dynet::expr::Expression matrix;
+        std::vector<float> values;
+
+        double score(const unsigned head, const unsigned mod) const
+        {
+            // column-major
+            return values[(mod - 1u) * n_heads + head];
+        }
+
+        // creates a new node in the graph
+        dynet::expr::Expression expr(const unsigned head, const unsigned mod) const
+        {
+            return dynet::expr::pick(dynet::expr::pick(matrix, head), mod - 1u);
+        }
+
+        // highest scoring head of modifier mod, the first one on ties
+        unsigned best_head(const unsigned mod) const
+        {
+            // the root is a candidate of every modifier
+            unsigned best = 0u;
+            for (unsigned head = 1u ; head < n_heads ; ++head)
+                if (head != mod && score(head, mod) > score(best, mod))
+                    best = head;
+            return best;
+        }
+
+        // scores of all the heads of modifier mod (n_heads x 1),
+        // creates a new node in the graph
+        dynet::expr::Expression column(const unsigned mod) const
+        {
+            return dynet::expr::select_cols(matrix, {mod - 1u});
+        }
+
+        // scores of the candidate heads of modifier mod, i.e. the column
+        // without head == mod, see candidate_index()
+        dynet::expr::Expression candidates(const unsigned mod) const
+        {
+            dynet::expr::Expression heads = column(mod);
+            if (mod + 1u == n_heads)
+                return dynet::expr::pickrange(heads, 0u, mod);
+            return dynet::expr::concatenate({
+                dynet::expr::pickrange(heads, 0u, mod),
+                dynet::expr::pickrange(heads, mod + 1u, n_heads)
+            });
+        }
+
+        // position of head in candidates(mod)
+        static unsigned candidate_index(const unsigned head, const unsigned mod)
+        {
+            return (head < mod ? head : head - 1u);
+        }
+    };
+
+    // call op(head, modifier, score, expression) for each arc
     template<class Op>
     void compute(
         dynet::ComputationGraph& cg, 
@@ -95,6 +154,54 @@ struct NeuralBiaffineParser
         bool dropout = false,
         double dropout_p = 0.5
     )
+    {
+        Scores scores = compute_matrix(cg, sentence, word_dropout, dropout, dropout_p);
+
+        for (unsigned head_index = 0 ; head_index <= sentence.size() ; ++head_index)
+        {
+            for (unsigned mod_index = 1 ; mod_index <= sentence.size() ; ++ mod_index)
+            {
+                if (head_index == mod_index)
+                    continue;
+
+                dynet::expr::Expression output = scores.expr(head_index, mod_index);
+                op(head_index, mod_index, scores.score(head_index, mod_index), output);
+            }
+        }
+    }
+
+    // call op(head, modifier, score) for each arc,
+    // without building an expression per arc
+    template<class Op>
+    void compute_scores(
+        dynet::ComputationGraph& cg, 
+        const IntSentence& sentence,
+        Op op
+    )
+    {
+        Scores scores = compute_matrix(cg, sentence);
+
+        for (unsigned head_index = 0 ; head_index <= sentence.size() ; ++head_index)
+        {
+            for (unsigned mod_index = 1 ; mod_index <= sentence.size() ; ++ mod_index)
+            {
+                if (head_index == mod_index)
+                    continue;
+
+                op(head_index, mod_index, scores.score(head_index, mod_index));
+            }
+        }
+    }
+
+    // biaffine scores of all the arcs in one expression and one forward pass:
+    // H^T W M + (b_h H)^T 1^T + 1 (b_m M) + bias
+    Scores compute_matrix(
+        dynet::ComputationGraph& cg, 
+        const IntSentence& sentence,
+        bool word_dropout = false,
+        bool dropout = false,
+        double dropout_p = 0.5
+    )
     {
         // RNN stuff for building embeddings
 
@@ -141,8 +248,8 @@ struct NeuralBiaffineParser
         std::vector<dynet::expr::Expression> cache_head_word;
         cache_head_word.push_back(e_hidden_layer_head_word * e_root_embedding);
 
-        // unused first element
-        std::vector<dynet::expr::Expression> cache_mod_word(1);
+        // no root modifier
+        std::vector<dynet::expr::Expression> cache_mod_word;
 
         for (unsigned int i = 0 ; i < rnn_word_embeddings.size() ; ++i)
         {
@@ -166,36 +273,39 @@ struct NeuralBiaffineParser
             }
         }
 
-        for (unsigned head_index = 0 ; head_index <= sentence.size() ; ++head_index)
-        {
-            for (unsigned mod_index = 1 ; mod_index <= sentence.size() ; ++ mod_index)
-            {
-                if (head_index == mod_index)
-                    continue;
-
-                dynet::expr::Expression head = cache_head_word.at(head_index);
-                dynet::expr::Expression mod = cache_mod_word.at(mod_index);
-
-                dynet::expr::Expression output =
-                    (
-                        dynet::expr::transpose(head)
-                        *
-                        e_ba_head_mod
-                        *
-                        mod
-                    )
-                    +
-                    (e_ba_head * head)
-                    +
-                    (e_ba_mod * mod)
-                    +
-                    e_ba_bias
-                ;
-
-                auto score = as_scalar(cg.get_value(output.i));
-                op(head_index, mod_index, score, output);
-            }
-        }
+        const unsigned n_heads = cache_head_word.size();
+        const unsigned n_mods = cache_mod_word.size();
+
+        Scores scores;
+        scores.n_heads = n_heads;
+        if (n_mods == 0u)
+            return scores;
+
+        // hidden_units x n_heads and hidden_units x n_mods
+        dynet::expr::Expression heads = dynet::expr::concatenate_cols(cache_head_word);
+        dynet::expr::Expression mods = dynet::expr::concatenate_cols(cache_mod_word);
+
+        // the linear terms are broadcast with outer products
+        dynet::expr::Expression head_ones = dynet::expr::input(cg, {n_heads, 1u}, std::vector<float>(n_heads, 1.f));
+        dynet::expr::Expression mod_ones = dynet::expr::input(cg, {1u, n_mods}, std::vector<float>(n_mods, 1.f));
+        dynet::expr::Expression e_ba_bias_row = e_ba_bias * dynet::expr::transpose(head_ones);
+
+        scores.matrix =
+            (
+                dynet::expr::transpose(heads)
+                *
+                e_ba_head_mod
+                *
+                mods
+            )
+            +
+            (dynet::expr::transpose(e_ba_head * heads + e_ba_bias_row) * mod_ones)
+            +
+            (head_ones * (e_ba_mod * mods))
+        ;
+        scores.values = dynet::as_vector(cg.get_value(scores.matrix.i));
+
+        return scores;
     }
 };
 
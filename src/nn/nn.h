@@ -33,6 +33,13 @@ struct NNSettings
     }
 };
 
+// arc and node scores of a sentence, see NNArc::Scores and NNNode2::Scores
+struct NNScores
+{
+    NNArc::Scores arcs;
+    NNNode2::Scores nodes;
+};
+
 template<class RNNBuilder>
 struct NN
 {
@@ -83,7 +90,7 @@ struct NN
         typename ArcContainer,
         typename NodeContainer
     >
-    void compute_exprs(
+    NNScores compute_exprs(
         dynet::ComputationGraph& cg, 
         const IntSentence& sentence,
         ArcOp arc_op,
@@ -128,7 +135,9 @@ struct NN
 
 
         // Feedforward part for computing scores !
-        nn_arc.compute(cg, arcs, arc_op, dep_word_embeddings);
-        nn_node.compute(cg, nodes, node_op, pos_word_embeddings);
+        NNScores scores;
+        scores.arcs = nn_arc.compute(cg, arcs, arc_op, dep_word_embeddings);
+        scores.nodes = nn_node.compute(cg, nodes, node_op, pos_word_embeddings);
+        return scores;
     }
 };
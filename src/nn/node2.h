@@ -29,17 +29,38 @@ struct NNNode2
         p_hidden_bias = model.add_parameters({t_n_pos});
     }
 
+    // Scores of every pos of every word, read from a single forward pass.
+    // Pick expressions are only built on demand
+    struct Scores
+    {
+        std::vector<dynet::expr::Expression> words;
+        std::vector<std::vector<float>> values;
+
+        double score(const unsigned word_index, const unsigned pos_index) const
+        {
+            return values.at(word_index).at(pos_index);
+        }
+
+        // creates a new node in the graph
+        template<class Node>
+        dynet::expr::Expression expr(const Node& node) const
+        {
+            return dynet::expr::pick(words.at(node.cluster), node.node);
+        }
+    };
+
+    // call op(node, score) for each node
     template<class Node2Container, class Op>
-    void compute(dynet::ComputationGraph& cg, const Node2Container& nodes, Op op, std::vector<dynet::expr::Expression>& word_embeddings)
+    Scores compute(dynet::ComputationGraph& cg, const Node2Container& nodes, Op op, std::vector<dynet::expr::Expression>& word_embeddings)
     {
         dynet::expr::Expression e_hidden_layer = parameter(cg, p_hidden_layer);
         dynet::expr::Expression e_hidden_bias = parameter(cg, p_hidden_bias);
 
 
-        std::vector<dynet::expr::Expression> cache_word;
+        Scores scores;
         for (unsigned int i = 0 ; i < word_embeddings.size(); ++i)
         {
-            cache_word.push_back(
+            scores.words.push_back(
                 dynet::expr::tanh(
                     e_hidden_layer * word_embeddings.at(i)
                     + 
@@ -48,18 +69,19 @@ struct NNNode2
             );
         }
 
-        for (auto const& node : nodes)
-        {
-            auto const word_index = node.cluster;
-            auto const pos_index = node.node;
+        if (scores.words.size() == 0u)
+            return scores;
 
-            dynet::expr::Expression output = 
-                dynet::expr::pick(cache_word.at(word_index), pos_index)
-            ;
+        // one forward for all the words, n_pos x n_words column-major
+        dynet::expr::Expression all_words = dynet::expr::concatenate_cols(scores.words);
+        const std::vector<float> values = dynet::as_vector(cg.get_value(all_words.i));
+        for (unsigned int i = 0 ; i < scores.words.size(); ++i)
+            scores.values.emplace_back(values.begin() + i * n_pos, values.begin() + (i + 1u) * n_pos);
 
-            auto score = as_scalar(cg.get_value(output.i));
-            op(node, score, output);
-        }
+        for (auto const& node : nodes)
+            op(node, scores.score(node.cluster, node.node));
+
+        return scores;
     }
 };
 
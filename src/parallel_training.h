@@ -0,0 +1,190 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <exception>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "dynet/dynet.h"
+#include "dynet/model.h"
+#include "dynet/tensor.h"
+
+#include "serialization.h"
+
+// Data-parallel training epochs for the local-loss trainers.
+//
+// dynet only supports one computation graph per process, so workers are
+// processes rather than threads: the calling process is worker 0 and the
+// others are forked at each epoch. Batch k is trained by worker
+// k % n_workers on its own copy of the model, then the parameters of the
+// workers are averaged (iterative parameter mixing). Each worker has its
+// own random sequence (word dropout) drawn from the caller's one, so for a
+// given seed and number of workers the results are deterministic.
+
+// training statistics, summed over the workers
+struct EpochStats
+{
+    double loss = 0.0;
+    unsigned n_correct = 0u;
+    unsigned n_total = 0u;
+};
+
+// all the parameter values of a model, in a fixed order
+std::vector<std::vector<float>> model_values(dynet::Model& model)
+{
+    std::vector<std::vector<float>> values;
+    for (auto p : model.parameters_list())
+        values.push_back(dynet::as_vector(p->values));
+    for (auto p : model.lookup_parameters_list())
+        for (auto const& tensor : p->values)
+            values.push_back(dynet::as_vector(tensor));
+    return values;
+}
+
+void set_model_values(dynet::Model& model, const std::vector<std::vector<float>>& values)
+{
+    unsigned i = 0u;
+    for (auto p : model.parameters_list())
+        dynet::TensorTools::SetElements(p->values, values.at(i ++));
+    for (auto p : model.lookup_parameters_list())
+        for (auto& tensor : p->values)
+            dynet::TensorTools::SetElements(tensor, values.at(i ++));
+}
+
+// op(batch, stats) trains the model on one batch and updates stats.
+// Worker files are written with the path_prefix prefix and removed.
+template<class Op>
+void run_parallel_epoch(
+    dynet::Model& model,
+    const std::vector<std::vector<unsigned>>& batches,
+    const unsigned n_workers,
+    const std::string& path_prefix,
+    EpochStats& stats,
+    Op op
+)
+{
+    if (n_workers <= 1u)
+    {
+        for (auto const& batch : batches)
+            op(batch, stats);
+        return;
+    }
+
+    auto run_worker = [&] (const unsigned worker, EpochStats& worker_stats)
+    {
+        for (unsigned k = worker ; k < batches.size() ; k += n_workers)
+            op(batches.at(k), worker_stats);
+    };
+    auto model_path = [&] (const unsigned worker)
+    {
+        return path_prefix + ".worker." + std::to_string(worker) + ".param";
+    };
+    auto stats_path = [&] (const unsigned worker)
+    {
+        return path_prefix + ".worker." + std::to_string(worker) + ".stats";
+    };
+
+    std::vector<unsigned> seeds(n_workers);
+    for (auto& seed : seeds)
+        seed = rand();
+
+    std::cout << std::flush;
+    std::cerr << std::flush;
+
+    std::vector<pid_t> children;
+    for (unsigned worker = 1u ; worker < n_workers ; ++worker)
+    {
+        const pid_t pid = fork();
+        if (pid < 0)
+            throw std::runtime_error("Unable to fork a training worker");
+
+        if (pid == 0)
+        {
+            // the worker must not return into the caller's code
+            int exit_code = 0;
+            try
+            {
+                srand(seeds.at(worker));
+                EpochStats worker_stats;
+                run_worker(worker, worker_stats);
+
+                save_object(model_path(worker), model);
+                std::ofstream out(stats_path(worker));
+                out.precision(17);
+                out << worker_stats.loss << " " << worker_stats.n_correct << " " << worker_stats.n_total << std::endl;
+                out.close();
+                if (!out)
+                    exit_code = 1;
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "Training worker " << worker << ": " << e.what() << std::endl;
+                exit_code = 1;
+            }
+            std::cout << std::flush;
+            _exit(exit_code);
+        }
+
+        children.push_back(pid);
+    }
+
+    srand(seeds.at(0u));
+    std::exception_ptr error;
+    try
+    {
+        run_worker(0u, stats);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    bool workers_ok = true;
+    for (const pid_t pid : children)
+    {
+        int status = 0;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            workers_ok = false;
+    }
+    if (error)
+        std::rethrow_exception(error);
+    if (!workers_ok)
+        throw std::runtime_error("A training worker failed");
+
+    // average the parameters, in worker order
+    std::vector<std::vector<float>> sums = model_values(model);
+    for (unsigned worker = 1u ; worker < n_workers ; ++worker)
+    {
+        read_object(model_path(worker), model);
+        const std::vector<std::vector<float>> values = model_values(model);
+        for (unsigned i = 0u ; i < sums.size() ; ++i)
+            for (unsigned j = 0u ; j < sums[i].size() ; ++j)
+                sums[i][j] += values[i][j];
+
+        std::ifstream in(stats_path(worker));
+        EpochStats worker_stats;
+        in >> worker_stats.loss >> worker_stats.n_correct >> worker_stats.n_total;
+        if (!in)
+            throw std::runtime_error("Unable to read the statistics of training worker " + std::to_string(worker));
+        in.close();
+        stats.loss += worker_stats.loss;
+        stats.n_correct += worker_stats.n_correct;
+        stats.n_total += worker_stats.n_total;
+
+        std::remove(model_path(worker).c_str());
+        std::remove(stats_path(worker).c_str());
+    }
+
+    for (auto& sum : sums)
+        for (auto& value : sum)
+            value /= (float) n_workers;
+    set_model_values(model, sums);
+}
@@ -1,17 +1,27 @@
 #pragma once
 
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
 #include "status.h"
 #include "decoder/dual.h"
 
 
 // force an unselected node to be selected in the cluster subproblems
-bool reduction_node(Status& status, DualDecoder& decoder, double dual_weight)
+template <class Weight>
+bool reduction_node(BasicStatus<Weight>& status, BasicDualDecoder<Weight>& decoder, Weight dual_weight)
 {
     bool reduced = false;
 
-    for (auto const& cluster_decoder : decoder.cluster_decoders)
+    for (unsigned c = 0u ; c < decoder.cluster_decoders.size() ; ++c)
     {
-        double max_cluster_weight = cluster_decoder._weights_cache[cluster_decoder._max_index_cache];
+        // nothing left to remove
+        if (status.cluster_available_nodes.at(c) <= 1u)
+            continue;
+
+        auto const& cluster_decoder = decoder.cluster_decoders[c];
+        Weight max_cluster_weight = cluster_decoder._weights_cache[cluster_decoder._max_index_cache];
 
         for (unsigned i = 0u ; i < cluster_decoder._weights_cache.size() ; ++i)
         {
@@ -22,25 +32,16 @@ bool reduction_node(Status& status, DualDecoder& decoder, double dual_weight)
             {
                 reduced = true;
 
-                status.allowed_nodes[cluster_decoder.decoders[i].node_index] = false;
-                status.node_weights[cluster_decoder.decoders[i].node_index] = -std::numeric_limits<double>::infinity();
+                status.disable_node(cluster_decoder.decoders[i].node_index);
 
                 for (int index : cluster_decoder.decoders[i].incoming_indices)
                 {
-                    status.allowed_arcs.at(index) = false;
-
-                    status.cmsa_weights[index] = -std::numeric_limits<double>::infinity();
-                    status.incoming_weights[index] = -std::numeric_limits<double>::infinity();
-                    status.outgoing_weights[index] = -std::numeric_limits<double>::infinity();
+                    status.disable_arc(index);
                 }
                 for (auto const& v : cluster_decoder.decoders[i].outgoing_indices)
                     for (int index : v)
                     {
-                        status.allowed_arcs[index] = false;
-
-                        status.cmsa_weights[index] = -std::numeric_limits<double>::infinity();
-                        status.incoming_weights[index] = -std::numeric_limits<double>::infinity();
-                        status.outgoing_weights[index] = -std::numeric_limits<double>::infinity();
+                        status.disable_arc(index);
                     }
             }
         }
@@ -50,7 +51,8 @@ bool reduction_node(Status& status, DualDecoder& decoder, double dual_weight)
 }
 
 // change the incoming arc of the selected node in a cluster
-bool reduction_incoming(Status& status, DualDecoder& decoder, double dual_weight)
+template <class Weight>
+bool reduction_incoming(BasicStatus<Weight>& status, BasicDualDecoder<Weight>& decoder, Weight dual_weight)
 {
     bool reduced = false;
 
@@ -60,7 +62,9 @@ bool reduction_incoming(Status& status, DualDecoder& decoder, double dual_weight
         unsigned i = cluster_decoder._max_index_cache;
 
         int selected_index = cluster_decoder.decoders.at(i)._incoming_selected;
-        double selected_weight = status.incoming_weights.at(selected_index);
+        if (selected_index < 0)
+            continue;
+        Weight selected_weight = status.incoming_weights.at(selected_index);
 
         for (unsigned index : cluster_decoder.decoders.at(i).incoming_indices)
         {
@@ -71,11 +75,7 @@ bool reduction_incoming(Status& status, DualDecoder& decoder, double dual_weight
             {
                 reduced = true;
 
-                status.allowed_arcs.at(index) = false;
-
-                status.cmsa_weights[index] = -std::numeric_limits<double>::infinity();
-                status.incoming_weights[index] = -std::numeric_limits<double>::infinity();
-                status.outgoing_weights[index] = -std::numeric_limits<double>::infinity();
+                status.disable_arc(index);
             }
         }
     }
@@ -85,7 +85,8 @@ bool reduction_incoming(Status& status, DualDecoder& decoder, double dual_weight
 
 
 // add an outgoing arc to the selected node in a cluster
-bool reduction_outgoing_0(Status& status, DualDecoder& decoder, double dual_weight)
+template <class Weight>
+bool reduction_outgoing_0(BasicStatus<Weight>& status, BasicDualDecoder<Weight>& decoder, Weight dual_weight)
 {
     bool reduced = false;
 
@@ -94,7 +95,7 @@ bool reduction_outgoing_0(Status& status, DualDecoder& decoder, double dual_weig
         unsigned i = cluster_decoder._max_index_cache;
         for (unsigned j = 0 ; j < cluster_decoder.decoders.at(i)._outgoing_selected.size() ; ++j)
         {
-            double selected_weight = 0.0;
+            Weight selected_weight = 0.0;
             if (cluster_decoder.decoders.at(i)._outgoing_selected.at(j) >= 0)
                 selected_weight = status.outgoing_weights.at(cluster_decoder.decoders.at(i)._outgoing_selected.at(j));
 
@@ -107,11 +108,7 @@ bool reduction_outgoing_0(Status& status, DualDecoder& decoder, double dual_weig
                 {
                     reduced = true;
 
-                    status.allowed_arcs.at(index) = false;
-
-                    status.cmsa_weights[index] = -std::numeric_limits<double>::infinity();
-                    status.incoming_weights[index] = -std::numeric_limits<double>::infinity();
-                    status.outgoing_weights[index] = -std::numeric_limits<double>::infinity();
+                    status.disable_arc(index);
                 }
             }
         }
@@ -121,7 +118,8 @@ bool reduction_outgoing_0(Status& status, DualDecoder& decoder, double dual_weig
 }
 
 
-void remove_inaccessibles(Status& status, DualDecoder& decoder)
+template <class Weight>
+void remove_inaccessibles(BasicStatus<Weight>& status, BasicDualDecoder<Weight>& decoder)
 {
     bool has_changed;
     do
@@ -148,26 +146,22 @@ void remove_inaccessibles(Status& status, DualDecoder& decoder)
                 if (accessible)
                     continue;
 
-                status.allowed_nodes[node_decoder.node_index] = false;
-                status.node_weights[node_decoder.node_index] = -std::numeric_limits<double>::infinity();
+                status.disable_node(node_decoder.node_index);
 
                 for (auto const& v : node_decoder.outgoing_indices)
                     for (int index : v)
                     {
                         has_changed = true;
 
-                        status.allowed_arcs[index] = false;
-
-                        status.cmsa_weights[index] = -std::numeric_limits<double>::infinity();
-                        status.incoming_weights[index] = -std::numeric_limits<double>::infinity();
-                        status.outgoing_weights[index] = -std::numeric_limits<double>::infinity();
+                        status.disable_arc(index);
                     }
             }
         }
     } while (has_changed);
 }
 
-bool reduction(Status& status, DualDecoder& decoder, double dual_weight)
+template <class Weight>
+bool reduction(BasicStatus<Weight>& status, BasicDualDecoder<Weight>& decoder, Weight dual_weight)
 {
     if (
         reduction_node(status, decoder, dual_weight)
@@ -182,3 +176,43 @@ bool reduction(Status& status, DualDecoder& decoder, double dual_weight)
     }
     return false;
 }
+
+// Decides when to run a reduction pass.
+// Nothing can be removed while there is no primal solution. Otherwise,
+// when adaptive, a pass that removed nothing is retried after twice as
+// many iterations (up to max_interval), or as soon as the duality gap
+// has decreased by gap_ratio since the last attempt.
+struct ReductionSchedule
+{
+    bool adaptive;
+    unsigned max_interval;
+    double gap_ratio;
+
+    unsigned interval = 1u;
+    unsigned next_iteration = 0u;
+    double last_gap = std::numeric_limits<double>::infinity();
+
+    ReductionSchedule(bool t_adaptive, unsigned t_max_interval, double t_gap_ratio)
+        : adaptive(t_adaptive), max_interval(t_max_interval), gap_ratio(t_gap_ratio)
+    {}
+
+    bool should_run(const unsigned iteration, const double gap) const
+    {
+        if (!adaptive)
+            return true;
+        if (!std::isfinite(gap))
+            return false;
+        return iteration >= next_iteration || gap < gap_ratio * last_gap;
+    }
+
+    void update(const unsigned iteration, const double gap, const unsigned n_removed)
+    {
+        if (n_removed > 0u)
+            interval = 1u;
+        else
+            interval = std::min(2u * interval, max_interval);
+
+        next_iteration = iteration + interval;
+        last_gap = gap;
+    }
+};
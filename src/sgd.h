@@ -1,6 +1,10 @@
 #pragma once
 
+#include <algorithm>
+
 #include "status.h"
+#include "bitset.h"
+#include "dual_optimizer.h"
 #include "utils.h"
 
 struct StepsizeOptions
@@ -12,13 +16,82 @@ struct StepsizeOptions
     bool decreasing = true;
     bool constant_decreasing = false;
     double gamma = 1.5;
+    bool sparse = false;
+    DualOptimizer optimizer = DualOptimizer::subgradient;
 };
 
-struct Subgradient
+// Stepsize rules, resolved at compile time in Subgradient::update_with()
+struct NoDecrease
 {
-    typedef std::vector<double> GradientType;
+    static double apply(const double stepsize, const double, const double)
+    {
+        return stepsize;
+    }
+};
+
+// decrease each time the dual increases
+struct IncreaseDecrease
+{
+    static double apply(const double stepsize, const double, const double n_increasing)
+    {
+        return stepsize / (1.0 + n_increasing);
+    }
+};
+
+// decrease at each iteration
+struct IterationDecrease
+{
+    static double apply(const double stepsize, const double iteration, const double)
+    {
+        return stepsize / (1.0 + iteration);
+    }
+};
+
+template <bool Momentum, bool Polyak, class Decrease>
+struct StepsizePolicy
+{
+    static const bool momentum = Momentum;
+    static const bool polyak = Polyak;
+    typedef Decrease decrease;
+};
+
+// Runtime dispatch: calls op.update_with<Policy>() with the policy
+// matching the options
+template <bool Momentum, bool Polyak, class Op>
+unsigned _dispatch_decrease(const StepsizeOptions& options, Op& op)
+{
+    if (!options.decreasing)
+        return op.template update_with<StepsizePolicy<Momentum, Polyak, NoDecrease>>();
+    if (options.constant_decreasing)
+        return op.template update_with<StepsizePolicy<Momentum, Polyak, IterationDecrease>>();
+    return op.template update_with<StepsizePolicy<Momentum, Polyak, IncreaseDecrease>>();
+}
+
+template <bool Momentum, class Op>
+unsigned _dispatch_polyak(const StepsizeOptions& options, Op& op)
+{
+    if (options.polyak)
+        return _dispatch_decrease<Momentum, true>(options, op);
+    return _dispatch_decrease<Momentum, false>(options, op);
+}
+
+template <class Op>
+unsigned dispatch_stepsize_policy(const StepsizeOptions& options, Op& op)
+{
+    if (options.camerini)
+        return _dispatch_polyak<true>(options, op);
+    return _dispatch_polyak<false>(options, op);
+}
+
+// Weight is the precision of the weights and gradients,
+// scalars (norms, stepsize) are always computed in double precision
+template <class Weight>
+struct BasicSubgradient
+{
+    typedef BasicWeightVector<Weight> WeightVector;
+    typedef WeightVector GradientType;
     const StepsizeOptions options;
-    Status& status;
+    BasicStatus<Weight>& status;
 
     double gradient_norm;
     GradientType *gradient_cmsa;
@@ -33,7 +106,25 @@ struct Subgradient
     double iteration;
     double n_increasing;
 
-    Subgradient(const StepsizeOptions& t_options, Status& t_status)
+    // maintained by add_*(): squared norm of the current gradient and
+    // dot product with the previous one (before momentum)
+    double _norm = 0.0;
+    double _dot = 0.0;
+
+    // nesterov: weights after the last step (before extrapolation)
+    // and number of iterations since the last restart
+    WeightVector _step_cmsa;
+    WeightVector _step_incoming;
+    WeightVector _step_outgoing;
+    double _n_momentum = 0.0;
+
+    // sparse mode: indices where one of the gradients may be non-null
+    std::vector<unsigned> support;
+    std::vector<unsigned> previous_support;
+    Bitset in_support;
+    Bitset in_previous_support;
+
+    BasicSubgradient(const StepsizeOptions& t_options, BasicStatus<Weight>& t_status)
         : options(t_options), status(t_status)
     {
         iteration = -1.0;
@@ -49,9 +140,22 @@ struct Subgradient
             previous_gradient_incoming = new GradientType(status.arcs.size(), 0.0);
             previous_gradient_outgoing = new GradientType(status.arcs.size(), 0.0);
         }
+
+        if (options.sparse)
+        {
+            in_support.resize(status.arcs.size(), false);
+            in_previous_support.resize(status.arcs.size(), false);
+        }
+
+        if (options.optimizer == DualOptimizer::nesterov)
+        {
+            _step_cmsa = status.cmsa_weights;
+            _step_incoming = status.incoming_weights;
+            _step_outgoing = status.outgoing_weights;
+        }
     }
 
-    ~Subgradient()
+    ~BasicSubgradient()
     {
         delete gradient_cmsa;
         delete gradient_incoming;
@@ -76,16 +180,156 @@ struct Subgradient
                 swap(&gradient_cmsa, &previous_gradient_cmsa);
                 swap(&gradient_incoming, &previous_gradient_incoming);
                 swap(&gradient_outgoing, &previous_gradient_outgoing);
+
+                if (options.sparse)
+                {
+                    std::swap(support, previous_support);
+                    std::swap(in_support, in_previous_support);
+                }
+            }
+
+            _norm = 0.0;
+            _dot = 0.0;
+
+            if (options.sparse)
+            {
+                for (unsigned i : support)
+                {
+                    (*gradient_cmsa)[i] = 0.0;
+                    (*gradient_incoming)[i] = 0.0;
+                    (*gradient_outgoing)[i] = 0.0;
+                    in_support[i] = false;
+                }
+                support.clear();
+            }
+            else
+            {
+                std::fill(std::begin(*gradient_cmsa), std::end(*gradient_cmsa), 0.0);
+                std::fill(std::begin(*gradient_incoming), std::end(*gradient_incoming), 0.0);
+                std::fill(std::begin(*gradient_outgoing), std::end(*gradient_outgoing), 0.0);
             }
+        }
+    }
+
+    // move the gradients to a new arc indexing:
+    // arc i becomes arc new_index[i], or is dropped if new_index[i] < 0
+    void remap(const unsigned n_arcs, const std::vector<int>& new_index)
+    {
+        _remap(&gradient_cmsa, n_arcs, new_index);
+        _remap(&gradient_incoming, n_arcs, new_index);
+        _remap(&gradient_outgoing, n_arcs, new_index);
+
+        if (options.camerini)
+        {
+            _remap(&previous_gradient_cmsa, n_arcs, new_index);
+            _remap(&previous_gradient_incoming, n_arcs, new_index);
+            _remap(&previous_gradient_outgoing, n_arcs, new_index);
+        }
+
+        if (options.sparse)
+        {
+            _remap_support(support, in_support, n_arcs, new_index);
+            _remap_support(previous_support, in_previous_support, n_arcs, new_index);
+        }
 
-            std::fill(std::begin(*gradient_cmsa), std::end(*gradient_cmsa), 0.0);
-            std::fill(std::begin(*gradient_incoming), std::end(*gradient_incoming), 0.0);
-            std::fill(std::begin(*gradient_outgoing), std::end(*gradient_outgoing), 0.0);
+        if (options.optimizer == DualOptimizer::nesterov)
+        {
+            _remap_weights(_step_cmsa, n_arcs, new_index);
+            _remap_weights(_step_incoming, n_arcs, new_index);
+            _remap_weights(_step_outgoing, n_arcs, new_index);
+        }
+
+        // dropped arcs may have changed them
+        _norm = dot(*gradient_cmsa, *gradient_cmsa) + dot(*gradient_incoming, *gradient_incoming) + dot(*gradient_outgoing, *gradient_outgoing);
+        if (options.camerini)
+            _dot = dot(*gradient_cmsa, *previous_gradient_cmsa) + dot(*gradient_incoming, *previous_gradient_incoming) + dot(*gradient_outgoing, *previous_gradient_outgoing);
+    }
+
+    static void _remap(GradientType** gradient, const unsigned n_arcs, const std::vector<int>& new_index)
+    {
+        GradientType* new_gradient = new GradientType(n_arcs, 0.0);
+        for (unsigned i = 0u ; i < new_index.size() ; ++i)
+            if (new_index[i] >= 0)
+                (*new_gradient)[new_index[i]] = (**gradient)[i];
+
+        delete *gradient;
+        *gradient = new_gradient;
+    }
+
+    static void _remap_weights(WeightVector& weights, const unsigned n_arcs, const std::vector<int>& new_index)
+    {
+        WeightVector new_weights(n_arcs, -std::numeric_limits<Weight>::infinity());
+        for (unsigned i = 0u ; i < new_index.size() ; ++i)
+            if (new_index[i] >= 0)
+                new_weights[new_index[i]] = weights[i];
+        weights = std::move(new_weights);
+    }
+
+    static void _remap_support(std::vector<unsigned>& indices, Bitset& flags, const unsigned n_arcs, const std::vector<int>& new_index)
+    {
+        flags = Bitset(n_arcs, false);
+
+        unsigned size = 0u;
+        for (unsigned i : indices)
+        {
+            if (new_index[i] < 0)
+                continue;
+
+            indices[size ++] = new_index[i];
+            flags[new_index[i]] = true;
+        }
+        indices.resize(size);
+    }
+
+    void add_cmsa(const unsigned i)
+    {
+        _add(*gradient_cmsa, previous_gradient_cmsa, i);
+    }
+
+    void add_incoming(const unsigned i)
+    {
+        _add(*gradient_incoming, previous_gradient_incoming, i);
+    }
+
+    void add_outgoing(const unsigned i)
+    {
+        _add(*gradient_outgoing, previous_gradient_outgoing, i);
+    }
+
+    void _add(GradientType& gradient, const GradientType* previous_gradient, const unsigned i)
+    {
+        _norm += 2.0 * gradient[i] + 1.0;
+        if (options.camerini)
+            _dot += (*previous_gradient)[i];
+        gradient[i] += 1.0;
+        _touch(i);
+    }
+
+    void _touch(const unsigned i)
+    {
+        if (options.sparse && !in_support[i])
+        {
+            in_support[i] = true;
+            support.push_back(i);
         }
     }
 
     bool is_null()
     {
+        if (options.sparse)
+        {
+            for (unsigned i : support)
+            {
+                if (!(
+                    NEARLY_EQ_TOL((*gradient_cmsa)[i], (*gradient_incoming)[i]) 
+                    && 
+                    NEARLY_EQ_TOL((*gradient_cmsa)[i], (*gradient_outgoing)[i])
+                ))
+                    return false;
+            }
+            return true;
+        }
+
         for (unsigned i = 0u ; i < gradient_cmsa->size() ; ++i)
         {
             if (!(
@@ -101,85 +345,119 @@ struct Subgradient
     void dual_has_increased()
     {
         ++ n_increasing;
+        _n_momentum = 0.0;
     }
 
-    void _camerini_update()
+    unsigned update()
     {
-        if (NEARLY_EQ_TOL(iteration, 0.0))
-            return;
-
-        double beta = 
-            - options.gamma 
-            * 
-            (
-                dot(*gradient_cmsa, *previous_gradient_cmsa)
-                +
-                dot(*gradient_incoming, *previous_gradient_incoming)
-                +
-                dot(*gradient_outgoing, *previous_gradient_outgoing)
-            )
-            / previous_gradient_norm
-        ;
-
-        beta = std::max(0.0, beta);
-
-        if (NEARLY_EQ_TOL(beta, 0.0))
-            return;
-
-        for (unsigned i = 0u ; i < gradient_cmsa->size() ; ++i)
-        {
-            (*gradient_cmsa)[i] += beta * (*previous_gradient_cmsa)[i];
-            (*gradient_incoming)[i] += beta * (*previous_gradient_incoming)[i];
-            (*gradient_outgoing)[i] += beta * (*previous_gradient_outgoing)[i];
-        }
+        return dispatch_stepsize_policy(options, *this);
     }
 
-    unsigned update()
+    template <class Policy>
+    unsigned update_with()
     {
-        unsigned nb_wrong = 0u;
-
-        if (options.camerini)
-            _camerini_update();
+        // Camerini et al. momentum: g += beta * previous g,
+        // applied in the weight update loop
+        double beta = 0.0;
+        if (Policy::momentum && !NEARLY_EQ_TOL(iteration, 0.0))
+        {
+            beta = std::max(0.0, - options.gamma * _dot / previous_gradient_norm);
+            if (NEARLY_EQ_TOL(beta, 0.0))
+                beta = 0.0;
+        }
 
-        if (options.polyak || options.camerini)
+        // |g + beta p|^2 = |g|^2 + 2 beta <g, p> + beta^2 |p|^2
+        if (Policy::momentum || Policy::polyak)
         {
-            gradient_norm = 0.0;
-            for (unsigned i = 0u ; i < status.arcs.size() ; ++i)
-            {
-                gradient_norm += pow((*gradient_cmsa)[i], 2);
-                gradient_norm += pow((*gradient_incoming)[i], 2);
-                gradient_norm += pow((*gradient_outgoing)[i], 2);
-            }
+            gradient_norm = _norm;
+            if (beta > 0.0)
+                gradient_norm = std::max(0.0, _norm + 2.0 * beta * _dot + beta * beta * previous_gradient_norm);
         }
 
         double stepsize = options.stepsize_scale;
-
-        if (options.polyak)
+        if (Policy::polyak)
             stepsize *= (options.polyak_wub * status.dual_weight - status.primal_weight) / gradient_norm;
+        stepsize = Policy::decrease::apply(stepsize, iteration, n_increasing);
 
-        if (options.decreasing)
+        // the extrapolation moves every arc, the support can't be used
+        if (options.optimizer == DualOptimizer::nesterov)
         {
-            if (options.constant_decreasing)
-                stepsize /= (1.0 + iteration);
-            else
-                stepsize /= (1.0 + n_increasing);
-        }
-
+            const double mu = _n_momentum / (_n_momentum + 3.0);
+            ++ _n_momentum;
 
-        for (unsigned i = 0u ; i < status.arcs.size() ; ++i)
-        {
-            double mean = ((*gradient_cmsa)[i] + (*gradient_incoming)[i] + (*gradient_outgoing)[i]) / 3.0;
+            // the momentum writes the previous gradient into the current one:
+            // keep the support in sync, as in the sparse update
+            if (options.sparse && beta > 0.0)
+                for (unsigned i : previous_support)
+                    _touch(i);
 
-            if (!NEARLY_BINARY(mean))
+            unsigned nb_wrong = 0u;
+            const unsigned n_arcs = status.arcs.size();
+            for (unsigned i = 0u ; i < n_arcs ; ++i)
             {
-                ++ nb_wrong;
-                status.cmsa_weights[i] -= stepsize * ((*gradient_cmsa)[i] - mean);
-                status.incoming_weights[i] -= stepsize * ((*gradient_incoming)[i] - mean);
-                status.outgoing_weights[i] -= stepsize * ((*gradient_outgoing)[i] - mean);
+                nb_wrong += _update_weights<Policy::momentum>(i, beta, stepsize);
+                _extrapolate(status.cmsa_weights[i], _step_cmsa[i], mu);
+                _extrapolate(status.incoming_weights[i], _step_incoming[i], mu);
+                _extrapolate(status.outgoing_weights[i], _step_outgoing[i], mu);
             }
+            return nb_wrong;
+        }
+
+        if (options.sparse)
+        {
+            // the support becomes the union of the current and previous ones
+            if (beta > 0.0)
+                for (unsigned i : previous_support)
+                    _touch(i);
+
+            unsigned nb_wrong = 0u;
+            for (unsigned i : support)
+                nb_wrong += _update_weights<Policy::momentum>(i, beta, stepsize);
+            return nb_wrong;
         }
 
+        unsigned nb_wrong = 0u;
+        const unsigned n_arcs = status.arcs.size();
+        for (unsigned i = 0u ; i < n_arcs ; ++i)
+            nb_wrong += _update_weights<Policy::momentum>(i, beta, stepsize);
         return nb_wrong;
     }
+
+    // branch-free, so the dense loop can be vectorized
+    template <bool Momentum>
+    unsigned _update_weights(const unsigned i, const Weight beta, const Weight stepsize)
+    {
+        Weight g_cmsa = (*gradient_cmsa)[i];
+        Weight g_incoming = (*gradient_incoming)[i];
+        Weight g_outgoing = (*gradient_outgoing)[i];
+        if (Momentum)
+        {
+            g_cmsa += beta * (*previous_gradient_cmsa)[i];
+            g_incoming += beta * (*previous_gradient_incoming)[i];
+            g_outgoing += beta * (*previous_gradient_outgoing)[i];
+            (*gradient_cmsa)[i] = g_cmsa;
+            (*gradient_incoming)[i] = g_incoming;
+            (*gradient_outgoing)[i] = g_outgoing;
+        }
+
+        const Weight mean = (g_cmsa + g_incoming + g_outgoing) / Weight(3);
+        const bool wrong = !(NEARLY_EQ_TOL(mean, Weight(1)) | NEARLY_EQ_TOL(mean, Weight(0)));
+
+        status.cmsa_weights[i] -= (wrong ? stepsize * (g_cmsa - mean) : Weight(0));
+        status.incoming_weights[i] -= (wrong ? stepsize * (g_incoming - mean) : Weight(0));
+        status.outgoing_weights[i] -= (wrong ? stepsize * (g_outgoing - mean) : Weight(0));
+        return wrong;
+    }
+
+    // weight = step + mu * (step - previous step),
+    // removed arcs (-inf) are left untouched
+    static void _extrapolate(Weight& weight, Weight& previous_step, const Weight mu)
+    {
+        const Weight step = weight;
+        const Weight extrapolated = step + mu * (step - previous_step);
+        previous_step = step;
+        weight = (std::isfinite(step) ? extrapolated : step);
+    }
 };
 
+typedef BasicSubgradient<double> Subgradient;
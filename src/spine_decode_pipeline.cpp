@@ -165,13 +165,11 @@ int main(int argc, char **argv)
         // Compute arc scores
         {
             dynet::ComputationGraph cg;
-            parser_nn.compute(
+            parser_nn.compute_scores(
                 cg,
                 sentence,
-                [&] (const unsigned head, const unsigned modifier, const double score, dynet::expr::Expression& expr) -> void
+                [&] (const unsigned head, const unsigned modifier, const double score) -> void
                 {
-                    unused_parameter(expr);
-
                     double new_score = score;
                     int mod_tpl = sentence[modifier].tpl;
 
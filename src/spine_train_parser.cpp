@@ -7,6 +7,7 @@
 #include <utility>
 #include <stdexcept>
 #include <cmath>
+#include <cstdlib>
 #include <chrono>
 #include <exception>
 #include <boost/filesystem.hpp>
@@ -24,6 +25,8 @@
 #include "serialization.h"
 #include "nn/biaffine_parser.h"
 #include "utils.h"
+#include "batch.h"
+#include "parallel_training.h"
 
 #include "dependency.h"
 #include "spine_data.h"
@@ -36,6 +39,9 @@ int main(int argc, char **argv)
     std::string dev_path;
     std::string model_path;
     unsigned n_iteration;
+    unsigned batch_size;
+    unsigned seed;
+    unsigned workers;
 
     bool probabilistic;
 
@@ -46,6 +52,7 @@ int main(int argc, char **argv)
 
     std::string ignore_dynet_mem;
     std::string ignore_dynet_wd;
+    std::string ignore_dynet_seed;
 
     unsigned n_stack;
     unsigned n_layer;
@@ -62,6 +69,9 @@ int main(int argc, char **argv)
         ("train", po::value<std::string>(&train_path)->required(), "")
         ("model", po::value<std::string>(&model_path)->required(), "")
         ("iteration", po::value<unsigned>(&n_iteration)->default_value(20), "")
+        ("batch-size", po::value<unsigned>(&batch_size)->default_value(1u), "number of sentences per update, batches are grouped by sentence length")
+        ("seed", po::value<unsigned>(&seed), "seed of the sentence order and word dropout (use --dynet-seed for the parameter initialization)")
+        ("workers", po::value<unsigned>(&workers)->default_value(1u), "number of training processes, their parameters are averaged after each epoch")
         ("eval-on-dev", po::value<bool>(&eval_on_dev)->default_value(false), "")
         ("dev-path", po::value<std::string>(&dev_path)->default_value(""), "")
         // dropout
@@ -70,6 +80,7 @@ int main(int argc, char **argv)
         // dynet
         ("dynet-mem", po::value<std::string>(&ignore_dynet_mem), "")
         ("dynet-weight-decay", po::value<std::string>(&ignore_dynet_wd), "")
+        ("dynet-seed", po::value<std::string>(&ignore_dynet_seed), "")
         // nn options
         ("activation-function", po::value<ActivationFunctionOption>(&activation_function), "") 
         ("lstm-dim", po::value<int>(&lstm_dim)->default_value(125))
@@ -94,6 +105,9 @@ int main(int argc, char **argv)
 
     dynet::initialize(argc, argv);
 
+    if (vm.count("seed"))
+        srand(seed);
+
     SpineSettings spine_settings;
     read_object(model_path + ".spine_settings.param", spine_settings);
     
@@ -158,97 +172,82 @@ int main(int argc, char **argv)
         unsigned n_correct = 0;
         unsigned n_total = 0;
         
-        std::random_shuffle(std::begin(train_data), std::end(train_data));
-
-        for (const IntSentence& sentence : train_data)
-        {
-            dynet::ComputationGraph cg;
-
-            // loss output
-            std::vector<Expression> errs;
-            
-            if (best_head)
+        EpochStats epoch_stats;
+        run_parallel_epoch(
+            model,
+            make_batches(train_data, batch_size),
+            workers,
+            model_path,
+            epoch_stats,
+            [&] (const std::vector<unsigned>& batch, EpochStats& stats)
             {
-                std::vector<unsigned> correct_indices(sentence.size());
-                std::vector<std::vector<Expression>> head_exprs(sentence.size());
+                // one graph and one update for all the sentences of the batch
+                dynet::ComputationGraph cg;
 
-                std::vector<std::vector<double>> scores(sentence.size());
+                // loss output
+                std::vector<Expression> errs;
 
-                rnn.compute(
-                    cg,
-                    sentence,
-                    [&] (unsigned head, unsigned modifier, double score, dynet::expr::Expression& expr) -> void
+                for (const unsigned sentence_index : batch)
+                {
+                    const IntSentence& sentence = train_data.at(sentence_index);
+
+                    if (best_head)
                     {
-                        if ((int) head == sentence[modifier].head)
-                            correct_indices.at(modifier-1) = head_exprs.at(modifier-1).size();
-                        head_exprs.at(modifier-1).push_back(expr);
+                        // one column of the score matrix per modifier,
+                        // instead of one expression per arc
+                        auto arc_scores = rnn.compute_matrix(
+                            cg,
+                            sentence,
+                            true, // word dropout
+                            dropout,
+                            dropout_p
+                        );
 
-                        if (!probabilistic)
+                        for (unsigned modifier = 1u ; modifier <= sentence.size() ; ++modifier)
                         {
-                            // loss augmented
-                            if ((int) head == sentence[modifier].head)
-                                score += 1.0;
-                            
-                            scores.at(modifier-1).push_back(score);
+                            const unsigned gold = sentence[modifier].head;
+                            const unsigned predicted = arc_scores.best_head(modifier);
+                            if (predicted == gold)
+                                stats.n_correct += 1;
+
+                            // loss
+                            if (probabilistic)
+                            {
+                                errs.push_back(pickneglogsoftmax(
+                                    arc_scores.candidates(modifier),
+                                    arc_scores.candidate_index(gold, modifier)
+                                ));
+                            }
+                            else if (predicted != gold)
+                            {
+                                dynet::expr::Expression heads = arc_scores.column(modifier);
+                                errs.push_back(dynet::expr::pick(heads, predicted) - dynet::expr::pick(heads, gold));
+                            }
                         }
-                    },
-                    true, // word dropout
-                    dropout,
-                    dropout_p
-                );
-
-                if (probabilistic)
-                {
-                    for (unsigned i = 0u ; i < correct_indices.size() ; ++i)
-                    {
-                        // loss
-                        dynet::expr::Expression heads = dynet::expr::concatenate(head_exprs.at(i));
-                        errs.push_back(pickneglogsoftmax(heads, correct_indices.at(i)));
-
-                        auto vec = dynet::as_vector(heads.value());
-                        int predicted = std::distance(std::begin(vec), std::max_element(std::begin(vec), std::end(vec)));
-                        if (predicted == (int) correct_indices.at(i))
-                            n_correct += 1;
                     }
-                }
-                else
-                {
-                    for (unsigned i = 0u ; i < correct_indices.size() ; ++i)
+                    else
                     {
-                        // loss
-                        dynet::expr::Expression heads = dynet::expr::concatenate(head_exprs.at(i));
-
-                        auto vec = dynet::as_vector(heads.value());
-                        int predicted = std::distance(std::begin(vec), std::max_element(std::begin(vec), std::end(vec)));
-                        if (predicted == (int) correct_indices.at(i))
-                        {
-                            n_correct += 1;
-                        }
-                        else
-                        {
-                            errs.push_back(dynet::expr::pick(heads, predicted) - pick(heads, correct_indices.at(i)));
-                        }
+                        // MSA decoding
+                        assert(!probabilistic);
+                        // TODO
+                        throw std::runtime_error("unimplemented");
                     }
+                    stats.n_total += sentence.size();
                 }
-            }
-            else
-            {
-                // MSA decoding
-                assert(!probabilistic);
-                // TODO
-                throw std::runtime_error("unimplemented");
-            }
-            n_total += sentence.size();
 
-            // backprop
-            if (errs.size() > 0)
-            {
-                Expression sum_errs = dynet::expr::sum(errs);
-                loss += as_scalar(cg.get_value(sum_errs.i));
-                cg.backward(sum_errs.i);
-                trainer.update(1.0);
+                // backprop
+                if (errs.size() > 0)
+                {
+                    Expression sum_errs = dynet::expr::sum(errs);
+                    stats.loss += as_scalar(cg.get_value(sum_errs.i));
+                    cg.backward(sum_errs.i);
+                    trainer.update(1.0);
+                }
             }
-        }
+        );
+        loss += epoch_stats.loss;
+        n_correct += epoch_stats.n_correct;
+        n_total += epoch_stats.n_total;
 
         trainer.update_epoch();
         trainer.status();
@@ -280,12 +279,11 @@ int main(int argc, char **argv)
                     assert(lemon_graph.id(node) == (int) i);
                 }
 
-                rnn.compute(
+                rnn.compute_scores(
                     cg,
                     sentence,
-                    [&] (unsigned head, unsigned modifier, double score, dynet::expr::Expression& expr) -> void
+                    [&] (unsigned head, unsigned modifier, double score) -> void
                     {
-                        unused_parameter(expr);
                         LArc lemon_arc = lemon_graph.addArc(
                             lemon_graph.nodeFromId(head),
                             lemon_graph.nodeFromId(modifier)
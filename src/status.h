@@ -1,58 +1,87 @@
 #pragma once
 
 #include <vector>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+#include <boost/functional/hash.hpp>
 
 #include "graph.h"
+#include "arc_vector.h"
+#include "bitset.h"
+#include "aligned_allocator.h"
 
-struct Status
+// Weight is the precision of the weights of the decoder
+template <class Weight>
+struct BasicStatus
 {
+    typedef BasicWeightVector<Weight> WeightVector;
+
     unsigned n_cluster;
 
-    double primal_weight;
-    double dual_weight;
+    Weight primal_weight;
+    Weight dual_weight;
 
-    std::vector<Arc> arcs;
+    ArcVector arcs;
     std::vector<Node> nodes;
 
-    std::vector<bool> allowed_arcs;
-    std::vector<bool> allowed_nodes;
+    Bitset allowed_arcs;
+    Bitset allowed_nodes;
 
-    std::vector<bool> primal_arcs;
+    Bitset primal_arcs;
 
-    std::vector<double> original_weights;
-    std::vector<double> cmsa_weights;
-    std::vector<double> incoming_weights;
-    std::vector<double> outgoing_weights;
-    std::vector<double> node_weights;
+    WeightVector original_weights;
+    WeightVector cmsa_weights;
+    WeightVector incoming_weights;
+    WeightVector outgoing_weights;
+    WeightVector node_weights;
 
     std::vector<int> selected_nodes;
 
-    Status()
+    // number of allowed elements, updated by disable_arc() and disable_node()
+    unsigned n_available_arcs = 0u;
+    unsigned n_available_nodes = 0u;
+    std::vector<unsigned> cluster_available_nodes;
+
+    // node id of each (cluster, node), -1 if absent,
+    // see build_node_index()
+    std::vector<std::vector<int>> cluster_node_indices;
+
+    // arcs grouped by (source node id, destination node id),
+    // see build_arc_index()
+    typedef std::pair<int, int> NodePair;
+    std::vector<unsigned> indexed_arcs;
+    std::unordered_map<NodePair, std::pair<unsigned, unsigned>, boost::hash<NodePair>> node_pair_arcs;
+
+    BasicStatus()
+    {
+        primal_weight = -std::numeric_limits<Weight>::infinity();
+        dual_weight = std::numeric_limits<Weight>::infinity();
+    }
+
+    // copy of the problem (graph and weights) in another precision
+    template <class Other>
+    explicit BasicStatus(const BasicStatus<Other>& other)
+        : BasicStatus()
     {
-        primal_weight = -std::numeric_limits<double>::infinity();
-        dual_weight = std::numeric_limits<double>::infinity();
+        n_cluster = other.n_cluster;
+        arcs = other.arcs;
+        nodes = other.nodes;
+        original_weights.assign(std::begin(other.original_weights), std::end(other.original_weights));
+        node_weights.assign(std::begin(other.node_weights), std::end(other.node_weights));
     }
 
     void erase_primal_solution()
     {
-        std::fill(
-                std::begin(primal_arcs),
-                std::end(primal_arcs),
-                false
-        );
+        primal_arcs.reset();
     }
 
     void primal_from_available_arcs()
     {
-        erase_primal_solution();
-        for (unsigned i = 0u ; i < allowed_arcs.size() ; ++i)
-        {
-            if (allowed_arcs[i])
-                primal_arcs[i] = true;
-        }
+        primal_arcs = allowed_arcs;
     }
 
-    void primal_from_subgradient(const std::vector<double>& v)
+    void primal_from_subgradient(const WeightVector& v)
     {
         erase_primal_solution();
         for (unsigned i = 0u ; i < v.size() ; ++i)
@@ -63,24 +92,132 @@ struct Status
     }
 
 
-    unsigned count_available_arcs()
+    void init_available_counts()
+    {
+        n_available_arcs = allowed_arcs.count();
+        n_available_nodes = allowed_nodes.count();
+
+        cluster_available_nodes.assign(n_cluster, 0u);
+        for (unsigned i = 0u ; i < nodes.size() ; ++i)
+            if (allowed_nodes[i])
+                ++ cluster_available_nodes.at(nodes[i].cluster);
+    }
+
+    unsigned count_available_arcs() const
+    {
+        return n_available_arcs;
+    }
+
+    unsigned count_available_nodes() const
+    {
+        return n_available_nodes;
+    }
+
+    // remove an arc from the problem,
+    // return false if it was already removed
+    bool disable_arc(const unsigned i)
+    {
+        if (!allowed_arcs[i])
+            return false;
+
+        allowed_arcs[i] = false;
+        -- n_available_arcs;
+
+        cmsa_weights[i] = -std::numeric_limits<Weight>::infinity();
+        incoming_weights[i] = -std::numeric_limits<Weight>::infinity();
+        outgoing_weights[i] = -std::numeric_limits<Weight>::infinity();
+
+        return true;
+    }
+
+    // remove a node from the problem (but not its arcs),
+    // return false if it was already removed
+    bool disable_node(const unsigned i)
+    {
+        if (!allowed_nodes[i])
+            return false;
+
+        allowed_nodes[i] = false;
+        -- n_available_nodes;
+        -- cluster_available_nodes.at(nodes[i].cluster);
+
+        node_weights[i] = -std::numeric_limits<Weight>::infinity();
+
+        return true;
+    }
+
+    void build_node_index()
     {
-        unsigned nb_available_arcs = 0;
-        for (bool b : allowed_arcs)
-            if (b)
-                ++ nb_available_arcs;
-        return nb_available_arcs;
+        cluster_node_indices.assign(n_cluster, std::vector<int>());
+        for (unsigned i = 0u ; i < nodes.size() ; ++i)
+        {
+            auto const& node = nodes[i];
+            auto& ids = cluster_node_indices.at(node.cluster);
+            if ((int) ids.size() <= node.node)
+                ids.resize(node.node + 1, -1);
+            ids[node.node] = i;
+        }
     }
 
-    unsigned count_available_nodes()
+    int node_index(const unsigned cluster, const int node) const
     {
-        unsigned nb_available_nodes = 0;
-        for (bool b : allowed_nodes)
-            if (b)
-                ++ nb_available_nodes;
-        return nb_available_nodes;
+        auto const& ids = cluster_node_indices.at(cluster);
+        if (node < 0 || node >= (int) ids.size())
+            return -1;
+        return ids[node];
     }
 
+    // also rebuilds the node index
+    void build_arc_index()
+    {
+        build_node_index();
 
+        std::vector<NodePair> arc_node_pairs(arcs.size());
+        for (unsigned i = 0u ; i < arcs.size() ; ++i)
+        {
+            auto const& arc = arcs[i];
+            arc_node_pairs[i] = NodePair(
+                node_index(arc.source, arc.source_node),
+                node_index(arc.destination, arc.destination_node)
+            );
+        }
+
+        indexed_arcs.resize(arcs.size());
+        for (unsigned i = 0u ; i < arcs.size() ; ++i)
+            indexed_arcs[i] = i;
+        std::stable_sort(
+            std::begin(indexed_arcs),
+            std::end(indexed_arcs),
+            [&] (const unsigned a, const unsigned b)
+            {
+                return arc_node_pairs[a] < arc_node_pairs[b];
+            }
+        );
+
+        node_pair_arcs.clear();
+        for (unsigned begin = 0u ; begin < indexed_arcs.size() ; )
+        {
+            auto const& key = arc_node_pairs[indexed_arcs[begin]];
+            unsigned end = begin + 1u;
+            while (end < indexed_arcs.size() && arc_node_pairs[indexed_arcs[end]] == key)
+                ++ end;
+
+            node_pair_arcs.emplace(key, std::make_pair(begin, end));
+            begin = end;
+        }
+    }
+
+    // call op(arc id) for each arc from node source to node destination
+    template<class Op>
+    void for_each_arc(const int source, const int destination, Op op) const
+    {
+        auto it = node_pair_arcs.find(NodePair(source, destination));
+        if (it == std::end(node_pair_arcs))
+            return;
+
+        for (unsigned i = it->second.first ; i < it->second.second ; ++i)
+            op(indexed_arcs[i]);
+    }
 };
 
+typedef BasicStatus<double> Status;
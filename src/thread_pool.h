@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+// Persistent pool of worker threads.
+// run(n, op) calls op(0), ..., op(n - 1) on the workers and on the calling
+// thread, and returns once all calls are done.
+// The first exception thrown by a call is re-thrown by run().
+struct ThreadPool
+{
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable cv_start;
+    std::condition_variable cv_done;
+
+    std::function<void(unsigned)> task;
+    unsigned n_tasks = 0u;
+    unsigned next_task = 0u;
+    unsigned n_done = 0u;
+    unsigned generation = 0u;
+    bool stopping = false;
+    std::exception_ptr error;
+
+    // n_threads includes the calling thread
+    explicit ThreadPool(const unsigned n_threads)
+    {
+        for (unsigned i = 1u ; i < n_threads ; ++i)
+            workers.emplace_back([this] () { _work(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv_start.notify_all();
+
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    unsigned size() const
+    {
+        return workers.size() + 1u;
+    }
+
+    template<class Op>
+    void run(const unsigned t_n_tasks, Op op)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task = op;
+            n_tasks = t_n_tasks;
+            next_task = 0u;
+            n_done = 0u;
+            error = nullptr;
+            ++ generation;
+        }
+        cv_start.notify_all();
+
+        _execute();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cv_done.wait(lock, [this] () { return n_done == n_tasks; });
+        task = nullptr;
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    void _execute()
+    {
+        while (true)
+        {
+            unsigned i;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (next_task >= n_tasks)
+                    return;
+                i = next_task ++;
+            }
+
+            try
+            {
+                task(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (++ n_done == n_tasks)
+                cv_done.notify_all();
+        }
+    }
+
+    void _work()
+    {
+        unsigned seen_generation = 0u;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv_start.wait(lock, [&] () { return stopping || generation != seen_generation; });
+                if (stopping)
+                    return;
+                seen_generation = generation;
+            }
+
+            _execute();
+        }
+    }
+};
@@ -30,6 +30,13 @@ struct Timer
         ;
     }
 
+    // accumulate the time measured by another timer
+    void add(const Timer& other)
+    {
+        assert(!other._running);
+        _total += other._total;
+    }
+
     double milliseconds() const
     {
         assert(!_running);
@@ -8,6 +8,7 @@
 #include <stdexcept>
 #include <cmath>
 #include <chrono>
+#include <cstdlib>
 
 #include "dynet/lstm.h"
 #include "dynet/training.h"
@@ -26,6 +27,9 @@
 #include "utils.h"
 #include "graph.h"
 #include "status.h"
+#include "multiplier_cache.h"
+#include "thread_pool.h"
+#include "batch.h"
 
 #include "dependency.h"
 #include "reader.h"
@@ -37,6 +41,9 @@ int main(int argc, char **argv)
     std::string dev_path;
     std::string model_path;
     unsigned n_iteration;
+    unsigned batch_size;
+    unsigned threads;
+    unsigned seed;
     bool use_cpos;
     bool limit_pos_distance;
 
@@ -46,9 +53,14 @@ int main(int argc, char **argv)
     StepsizeOptions stepsize_options;
     unsigned max_iteration;
     bool use_reduction;
+    MSAAlgorithmOption msa_algorithm;
+    DualOptimizerOption dual_optimizer;
+    DecoderOptions decoder_options;
+    unsigned multiplier_cache_mb;
 
     std::string ignore_dynet_mem;
     std::string ignore_dynet_wd;
+    std::string ignore_dynet_seed;
 
     unsigned dim_embeddings;
     unsigned lstm_shared_dim;
@@ -69,6 +81,9 @@ int main(int argc, char **argv)
         ("train", po::value<std::string>(&train_path)->required(), "")
         ("model", po::value<std::string>(&model_path)->required(), "")
         ("iteration", po::value<unsigned>(&n_iteration)->default_value(30u), "")
+        ("batch-size", po::value<unsigned>(&batch_size)->default_value(1u), "number of sentences per update, batches are grouped by sentence length")
+        ("threads", po::value<unsigned>(&threads)->default_value(1u), "number of sentences of a batch decoded in parallel")
+        ("seed", po::value<unsigned>(&seed), "seed of the sentence order and word dropout (use --dynet-seed for the parameter initialization)")
         ("cpos", po::value<bool>(&use_cpos)->default_value(false), "")
         ("limit-pos-distance", po::value<bool>(&limit_pos_distance)->default_value(true), "")
         ("eval-on-dev", po::value<bool>(&eval_on_dev)->default_value(false), "")
@@ -77,6 +92,17 @@ int main(int argc, char **argv)
         // SGD options for dev
         ("reduction", po::value<bool>(&use_reduction)->default_value(false), "")
         ("max-iteration", po::value<unsigned>(&max_iteration)->default_value(500), "")
+        ("msa", po::value<MSAAlgorithmOption>(&msa_algorithm), "MSA algorithm: lemon (default), sparse, dense or auto")
+        ("incremental-msa", po::value<bool>(&decoder_options.incremental_msa)->default_value(false), "MSA: warm start from the previous iteration (native algorithms only)")
+        ("incremental-msa-threshold", po::value<double>(&decoder_options.incremental_msa_threshold)->default_value(0.25), "MSA: full solve if more than this ratio of weights changed")
+        ("compaction-threshold", po::value<double>(&decoder_options.compaction_threshold)->default_value(0.0), "with reduction, compact the problem when the ratio of remaining arcs is below this value (0 to disable)")
+        ("reduction-incoming", po::value<bool>(&decoder_options.reduction_incoming)->default_value(false), "reduction: also remove incoming arcs")
+        ("reduction-outgoing", po::value<bool>(&decoder_options.reduction_outgoing)->default_value(false), "reduction: also remove outgoing arcs")
+        ("adaptive-reduction", po::value<bool>(&decoder_options.adaptive_reduction)->default_value(false), "reduction: schedule the passes from the duality gap and the number of removed elements")
+        ("reduction-max-interval", po::value<unsigned>(&decoder_options.reduction_max_interval)->default_value(16u), "reduction: maximum number of iterations between two passes with adaptive scheduling")
+        ("gap-tolerance", po::value<double>(&decoder_options.gap_tolerance)->default_value(0.0), "stop when the duality gap is below this value (0 to disable)")
+        ("relative-gap-tolerance", po::value<double>(&decoder_options.relative_gap_tolerance)->default_value(0.0), "stop when the duality gap is below this ratio of the dual value (0 to disable)")
+        ("time-budget-ms", po::value<double>(&decoder_options.time_budget_ms)->default_value(0.0), "maximum decoding time per sentence in milliseconds, the best primal is returned (0 to disable)")
         ("stepsize-scale", po::value<double>(&stepsize_options.stepsize_scale)->default_value(1.0), "SGD: stepsize scale")
         ("polyak", po::value<bool>(&stepsize_options.polyak)->default_value(false), "SGD: use polyak steapsize")
         ("polyak-wub", po::value<double>(&stepsize_options.polyak_wub)->default_value(1.0), "SGD: weight of the UB (>= 1.0)")
@@ -84,8 +110,12 @@ int main(int argc, char **argv)
         ("constant-decreasing", po::value<bool>(&stepsize_options.constant_decreasing)->default_value(false), "SGD: decrease stepsize at each iteration")
         ("camerini", po::value<bool>(&stepsize_options.camerini)->default_value(false), "SGD: use Camerini et al. momentum subgradient")
         ("gamma", po::value<double>(&stepsize_options.gamma)->default_value(1.5), "SGD: gamma paremeter for Camerini et al. momentum subgradient")
+        ("sparse-subgradient", po::value<bool>(&stepsize_options.sparse)->default_value(false), "SGD: only visit the arcs in the support of the subgradient")
+        ("dual-optimizer", po::value<DualOptimizerOption>(&dual_optimizer), "SGD: dual optimizer: subgradient or nesterov")
+        ("multiplier-cache-mb", po::value<unsigned>(&multiplier_cache_mb)->default_value(0u), "SGD: warm start each sentence from its multipliers at the previous epoch, cache size in MB (0 to disable)")
         ("dynet-mem", po::value<std::string>(&ignore_dynet_mem), "")
         ("dynet-weight-decay", po::value<std::string>(&ignore_dynet_wd), "")
+        ("dynet-seed", po::value<std::string>(&ignore_dynet_seed), "")
         // NN options
         ("dim-embeddings", po::value<unsigned>(&dim_embeddings)->default_value(100))
         ("lstm-shared-dim", po::value<unsigned>(&lstm_shared_dim)->default_value(125))
@@ -111,6 +141,15 @@ int main(int argc, char **argv)
 
     dynet::initialize(argc, argv);
 
+    if (vm.count("seed"))
+        srand(seed);
+
+    if (threads > batch_size)
+        std::cerr << "Warning: at most --batch-size sentences are decoded in parallel" << std::endl;
+
+    decoder_options.msa_algorithm = msa_algorithm.value;
+    stepsize_options.optimizer = dual_optimizer.value;
+
 
     dynet::Dict word_dict;
     dynet::Dict pos_dict;
@@ -208,6 +247,15 @@ int main(int argc, char **argv)
     save_object(model_path + ".node_nn_settings", nn_node_settings);
     save_object(model_path + ".graph_generator", graph_generator);
 
+    MultiplierCache multiplier_cache((std::size_t) multiplier_cache_mb * 1024u * 1024u);
+
+    // the network part is sequential (dynet graphs and builders can't be
+    // shared between threads): the sentences of a batch are scored in one
+    // graph, then decoded in parallel, each sentence by a single thread.
+    // The loss is built in the batch order, so for a given seed and batch
+    // size the results don't depend on the number of threads
+    ThreadPool thread_pool(threads);
+
     for (unsigned iteration = 0 ; iteration <= n_iteration ; ++iteration)
     {
         std::cerr << "Iteration: " << iteration << std::endl;
@@ -216,228 +264,251 @@ int main(int argc, char **argv)
         unsigned n_correct_head = 0;
         unsigned n_correct_pos = 0;
         unsigned n_total = 0;
+        DecoderTimer epoch_timer;
         
-        std::random_shuffle(std::begin(train_data), std::end(train_data));
-
-        for (auto const& sentence : train_data)
+        // the index in train_data identifies a sentence in the multiplier cache
+        for (auto const& batch : make_batches(train_data, batch_size))
         {
             dynet::ComputationGraph cg;
 
-            Status status;
-            status.n_cluster = sentence.size() + 1;
+            std::vector<Status> batch_status(batch.size());
+            std::vector<NNScores> batch_scores(batch.size());
 
-            // TODO: this may create some inaccessible node & arcs
-            // => do a reduction step before computing weights ?
-            graph_generator.build_arcs(
-                    sentence,
-                    [&] (const Arc& arc)
-                    {
-                        status.arcs.push_back(arc);
-                    },
-                    [&] (const Node& node)
-                    {
-                        status.nodes.push_back(node);
-                    },
-                    limit_pos_distance
-            );
+            for (unsigned k = 0u ; k < batch.size() ; ++k)
+            {
+                const unsigned sentence_id = batch.at(k);
+                auto const& sentence = train_data.at(sentence_id);
 
+                Status& status = batch_status.at(k);
+                status.n_cluster = sentence.size() + 1;
 
-            std::vector<dynet::expr::Expression> arc_exprs;
-            std::vector<dynet::expr::Expression> node_exprs;
-            rnn.compute_exprs(
-                cg,
-                sentence,
-                [&] (const Arc& arc, double weight, dynet::expr::Expression& expr) -> void
-                {
-                    arc_exprs.push_back(expr);
-
-                    status.original_weights.push_back(weight);
-
-                    // loss-augmented inference
-                    auto const& token = sentence[arc.destination];
-                    if (!arc.is(
-                        token.head,
-                        token.head == 0 ? nn_settings.n_pos : sentence[token.head].pos,
-                        token.index,
-                        token.pos
-                    ))
-                        weight += 1.0;
-
-                    double w = weight / 3.0;
-                    status.cmsa_weights.push_back(w);
-                    status.incoming_weights.push_back(w);
-                    status.outgoing_weights.push_back(w);
-                },
-                [&] (const Node& node, double weight, dynet::expr::Expression& expr) -> void
-                {
-                    unused_parameter(expr);
+                // TODO: this may create some inaccessible node & arcs
+                // => do a reduction step before computing weights ?
+                graph_generator.build_arcs(
+                        sentence,
+                        [&] (const Arc& arc)
+                        {
+                            status.arcs.push_back(arc);
+                        },
+                        [&] (const Node& node)
+                        {
+                            status.nodes.push_back(node);
+                        },
+                        limit_pos_distance
+                );
 
-                    node_exprs.push_back(expr);
 
-                    if (node.cluster != 0)
+                batch_scores.at(k) = rnn.compute_exprs(
+                    cg,
+                    sentence,
+                    [&] (const Arc& arc, double weight) -> void
                     {
-                        auto const& token = sentence[node.cluster];
-                        if (token.pos != node.node)
+                        status.original_weights.push_back(weight);
+
+                        // loss-augmented inference
+                        auto const& token = sentence[arc.destination];
+                        if (!arc.is(
+                            token.head,
+                            token.head == 0 ? nn_settings.n_pos : sentence[token.head].pos,
+                            token.index,
+                            token.pos
+                        ))
                             weight += 1.0;
-                    }
-                    status.node_weights.push_back(weight);
-                },
-                status.arcs,
-                status.nodes,
-                true // dropout
-            );
-
-            Subgradient subgradient(stepsize_options, status);
-            DecoderTimer timer;
-            // TODO: use decode_dual instead
-            // but then we need to have parameter for loss augmented + word dropout
-            bool converged = decode(
-                status,
-                subgradient,
-                max_iteration,
-                use_reduction,
-                timer
-            );
-
-            std::vector<double> arc_outputs(status.arcs.size(), 0.0);
-            std::vector<double> node_outputs(status.nodes.size(), 0.0);
 
-            // if converged primal = dual
-            if (converged)
-            {
-                assert(std::isfinite(status.primal_weight));
-                std::vector<int> nodes(status.n_cluster);
-
-                for (unsigned i = 0u ; i < status.arcs.size() ; ++i)
-                {
-                    if (!status.primal_arcs.at(i))
-                        continue;
+                        double w = weight / 3.0;
+                        status.cmsa_weights.push_back(w);
+                        status.incoming_weights.push_back(w);
+                        status.outgoing_weights.push_back(w);
+                    },
+                    [&] (const Node& node, double weight) -> void
+                    {
+                        if (node.cluster != 0)
+                        {
+                            auto const& token = sentence[node.cluster];
+                            if (token.pos != node.node)
+                                weight += 1.0;
+                        }
+                        status.node_weights.push_back(weight);
+                    },
+                    status.arcs,
+                    status.nodes,
+                    true // dropout
+                );
 
-                    arc_outputs[i] = 1.0;
-                    auto const arc = status.arcs.at(i);
-                    nodes.at(arc.destination) = arc.destination_node;
-                }
+                multiplier_cache.restore(sentence_id, status);
+            }
 
-                for (unsigned i = 0u ; i < status.nodes.size() ; ++i)
+            // decode
+            std::vector<std::vector<double>> batch_arc_outputs(batch.size());
+            std::vector<std::vector<double>> batch_node_outputs(batch.size());
+            std::vector<DecoderTimer> batch_timers(batch.size());
+            thread_pool.run(
+                batch.size(),
+                [&] (unsigned k)
                 {
-                    auto const node = status.nodes.at(i);
-                    if (node.cluster == 0)
-                        continue;
+                    Status& status = batch_status.at(k);
+
+                    Subgradient subgradient(stepsize_options, status);
+                    DecoderTimer& timer = batch_timers.at(k);
+                    // TODO: use decode_dual instead
+                    // but then we need to have parameter for loss augmented + word dropout
+                    bool converged = decode(
+                        status,
+                        subgradient,
+                        max_iteration,
+                        use_reduction,
+                        decoder_options,
+                        timer
+                    );
+
+                    std::vector<double>& arc_outputs = batch_arc_outputs.at(k);
+                    std::vector<double>& node_outputs = batch_node_outputs.at(k);
+                    arc_outputs.assign(status.arcs.size(), 0.0);
+                    node_outputs.assign(status.nodes.size(), 0.0);
+
+                    // if converged primal = dual
+                    if (converged)
+                    {
+                        assert(std::isfinite(status.primal_weight));
 
-                    if (node.node == nodes.at(node.cluster))
-                        node_outputs[i] = 1.0;
-                }
-            }
-            else
-            {
-                // TODO: use subgradient data instead
-                DualDecoder dual_decoder(status.n_cluster, status.arcs, status.nodes);
-                dual_decoder.maximize(
-                        status.cmsa_weights,
-                        status.incoming_weights,
-                        status.outgoing_weights,
-                        status.node_weights,
-                        [&] (const int i)
+                        for (unsigned i = 0u ; i < status.arcs.size() ; ++i)
                         {
-                            arc_outputs.at(i) += 1.0 / 3.0;
-                        },
-                        [&] (const int i)
-                        {
-                            arc_outputs.at(i) += 1.0 / 3.0;
-                        },
-                        [&] (const int i)
-                        {
-                            arc_outputs.at(i) += 1.0 / 3.0;
-                        },
-                        [&] (const int i)
-                        {
-                            node_outputs[i] = 1.0;
-                        }
-                );
-            }
+                            if (!status.primal_arcs.at(i))
+                                continue;
 
-            n_total += sentence.size();
+                            arc_outputs[i] = 1.0;
+                            auto const arc = status.arcs.at(i);
+                            node_outputs.at(status.node_index(arc.destination, arc.destination_node)) = 1.0;
+                        }
+                    }
+                    else
+                    {
+                        // TODO: use subgradient data instead
+                        DualDecoder dual_decoder(status.n_cluster, status.arcs, status.nodes, decoder_options.msa_algorithm);
+                        dual_decoder.maximize(
+                                status.cmsa_weights,
+                                status.incoming_weights,
+                                status.outgoing_weights,
+                                status.node_weights,
+                                [&] (const int i)
+                                {
+                                    arc_outputs.at(i) += 1.0 / 3.0;
+                                },
+                                [&] (const int i)
+                                {
+                                    arc_outputs.at(i) += 1.0 / 3.0;
+                                },
+                                [&] (const int i)
+                                {
+                                    arc_outputs.at(i) += 1.0 / 3.0;
+                                },
+                                [&] (const int i)
+                                {
+                                    node_outputs[i] = 1.0;
+                                }
+                        );
+                    }
+                }
+            );
 
             // build loss output
             std::vector<Expression> errs;
 
-            // for arcs
-            for (unsigned i = 0 ; i < status.arcs.size() ; ++i)
+            for (unsigned k = 0u ; k < batch.size() ; ++k)
             {
-                auto const& arc = status.arcs[i];
+                const unsigned sentence_id = batch.at(k);
+                auto const& sentence = train_data.at(sentence_id);
+                const Status& status = batch_status.at(k);
+                const NNScores& scores = batch_scores.at(k);
+                const std::vector<double>& arc_outputs = batch_arc_outputs.at(k);
+                const std::vector<double>& node_outputs = batch_node_outputs.at(k);
+
+                multiplier_cache.save(sentence_id, status);
 
-                // if head is root, do not check the source_node, it will always be correct
-                int head_pos = (arc.source > 0 ? sentence[arc.source].pos : arc.source_node);
-                auto const& modifier = sentence[arc.destination];
-                auto pred = arc_outputs[i];
+                // statistics in batch order
+                write_sentence_stats(std::cout, batch_timers.at(k));
+                epoch_timer.add(batch_timers.at(k));
 
-                double gold = (head_pos == arc.source_node && modifier.pos == arc.destination_node && modifier.head == arc.source) ? 1.0 : 0.0;
+                n_total += sentence.size();
 
-                if (!NEARLY_EQ_TOL(pred, gold))
+                // for arcs
+                for (unsigned i = 0 ; i < status.arcs.size() ; ++i)
                 {
-                    auto expr = arc_exprs.at(i);
+                    auto const& arc = status.arcs[i];
+
+                    // if head is root, do not check the source_node, it will always be correct
+                    int head_pos = (arc.source > 0 ? sentence[arc.source].pos : arc.source_node);
+                    auto const& modifier = sentence[arc.destination];
+                    auto pred = arc_outputs[i];
+
+                    double gold = (head_pos == arc.source_node && modifier.pos == arc.destination_node && modifier.head == arc.source) ? 1.0 : 0.0;
 
-                    if (!NEARLY_ZERO_TOL(pred))
+                    if (!NEARLY_EQ_TOL(pred, gold))
                     {
-                        if (NEARLY_EQ_TOL(pred, 1.0))
-                            errs.push_back(expr);
-                        else
-                            errs.push_back(pred * expr);
+                        auto expr = scores.arcs.expr(arc);
+
+                        if (!NEARLY_ZERO_TOL(pred))
+                        {
+                            if (NEARLY_EQ_TOL(pred, 1.0))
+                                errs.push_back(expr);
+                            else
+                                errs.push_back(pred * expr);
+                        }
+                        if (!NEARLY_ZERO_TOL(gold))
+                        {
+                            if (NEARLY_EQ_TOL(gold, 1.0))
+                                errs.push_back(- expr);
+                            else
+                                errs.push_back(- gold * expr);
+                        }
                     }
-                    if (!NEARLY_ZERO_TOL(gold))
+                    // equal to gold so we know it's binary
+                    else if (gold > 0.5)
                     {
-                        if (NEARLY_EQ_TOL(gold, 1.0))
-                            errs.push_back(- expr);
-                        else
-                            errs.push_back(- gold * expr);
+                        n_correct_head += 1.0;
                     }
                 }
-                // equal to gold so we know it's binary
-                else if (gold > 0.5)
-                {
-                    n_correct_head += 1.0;
-                }
-            }
 
 
-            // for nodes
-            for (unsigned i = 0 ; i < status.nodes.size() ; ++i)
-            {
-                auto const& node = status.nodes[i];
-
-                // Do not check node if root
-                if (node.cluster == 0)
-                    continue;
+                // for nodes
+                for (unsigned i = 0 ; i < status.nodes.size() ; ++i)
+                {
+                    auto const& node = status.nodes[i];
 
-                auto const& token_pos = sentence[node.cluster].pos;
+                    // Do not check node if root
+                    if (node.cluster == 0)
+                        continue;
 
-                auto pred = node_outputs[i];
+                    auto const& token_pos = sentence[node.cluster].pos;
 
-                double gold = (token_pos == node.node) ? 1.0 : 0.0;
-                if (!NEARLY_EQ_TOL(pred, gold))
-                {
-                    auto expr = node_exprs.at(i);
+                    auto pred = node_outputs[i];
 
-                    if (!NEARLY_ZERO_TOL(pred))
+                    double gold = (token_pos == node.node) ? 1.0 : 0.0;
+                    if (!NEARLY_EQ_TOL(pred, gold))
                     {
-                        if (NEARLY_EQ_TOL(pred, 1.0))
-                            errs.push_back(expr);
-                        else
-                            errs.push_back(pred * expr);
+                        auto expr = scores.nodes.expr(node);
+
+                        if (!NEARLY_ZERO_TOL(pred))
+                        {
+                            if (NEARLY_EQ_TOL(pred, 1.0))
+                                errs.push_back(expr);
+                            else
+                                errs.push_back(pred * expr);
+                        }
+                        if (!NEARLY_ZERO_TOL(gold))
+                        {
+                            if (NEARLY_EQ_TOL(gold, 1.0))
+                                errs.push_back(- expr);
+                            else
+                                errs.push_back(- gold * expr);
+                        }
                     }
-                    if (!NEARLY_ZERO_TOL(gold))
+                    // equal to gold so we know it's binary
+                    else if (gold > 0.5)
                     {
-                        if (NEARLY_EQ_TOL(gold, 1.0))
-                            errs.push_back(- expr);
-                        else
-                            errs.push_back(- gold * expr);
+                        n_correct_pos += 1;
                     }
                 }
-                // equal to gold so we know it's binary
-                else if (gold > 0.5)
-                {
-                    n_correct_pos += 1;
-                }
             }
 
             // backprop
@@ -462,6 +533,16 @@ int main(int argc, char **argv)
         ;
         std::cerr << "\tNode acc: " << n_correct_pos / (double) n_total << std::endl;
         std::cerr << "\tArc acc: " << n_correct_head / (double) n_total << std::endl;
+        if (multiplier_cache_mb > 0u)
+            std::cerr
+                << "\tMultiplier cache: "
+                << multiplier_cache.n_hits << " hits, "
+                << multiplier_cache.n_misses << " misses, "
+                << multiplier_cache.n_evictions << " evictions"
+                << std::endl;
+        std::cerr << "\tDecoder: ";
+        write_decoder_timer_header(std::cerr) << std::endl;
+        std::cerr << "\tDecoder: " << epoch_timer << std::endl;
         std::cerr << std::flush;
 
         save_object(model_path + ".param." + std::to_string(iteration), model);
@@ -491,6 +572,7 @@ int main(int argc, char **argv)
                     stepsize_options,
                     max_iteration,
                     use_reduction,
+                    decoder_options,
                     rnn,
                     [&] (unsigned index, unsigned head)
                     {
@@ -502,6 +584,7 @@ int main(int argc, char **argv)
                     },
                     timer
                 );
+                write_sentence_stats(std::cout, timer);
 
                 if (exact)
                     ++ n_exact;
@@ -1,13 +1,35 @@
 #pragma once
 
 #include <utility>
+#include <type_traits>
+#include <limits>
 #include <boost/functional/hash.hpp>
 
+// absolute tolerance of the comparisons, depends on the precision of the
+// values: single precision weights accumulate much larger rounding errors.
+// For double, sqrt(1e-9) i.e. AD3's squared tolerance of 1e-9
+template <class T>
+constexpr double tolerance()
+{
+    return 3.1622776601683795e-5;
+}
+
+// a few ulps of the weights of a sentence (sums of up to ~1000)
+template <>
+constexpr double tolerance<float>()
+{
+    return 1024.0 * std::numeric_limits<float>::epsilon();
+}
+
+// tolerance of the least precise operand
+#define TOL_OF(a) (tolerance<typename std::decay<decltype(a)>::type>())
+#define TOL_OF2(a,b) (TOL_OF(a) > TOL_OF(b) ? TOL_OF(a) : TOL_OF(b))
+
 // Stolen from AD3
-#define TOL 1e-9
-#define NEARLY_EQ_TOL(a,b) (((a)-(b))*((a)-(b))<=(TOL))                                                                                                                                                    
+#define TOL (tolerance<double>())
+#define NEARLY_EQ_TOL(a,b) ((((a)-(b))<=(TOL_OF2(a,b))) && (((b)-(a))<=(TOL_OF2(a,b))))
 #define NEARLY_BINARY(a) (NEARLY_EQ_TOL((a),1.0) || NEARLY_EQ_TOL((a),0.0))
-#define NEARLY_ZERO_TOL(a) (((a)<=(TOL)) && ((a)>=(-(TOL))))
+#define NEARLY_ZERO_TOL(a) (((a)<=(TOL_OF(a))) && ((a)>=(-(TOL_OF(a)))))
 #define STRICTLY_INF(a,b) (((a) < (b)) && !NEARLY_EQ_TOL((a), (b)))
 #define STRICTLY_SUP(a,b) (((a) > (b)) && !NEARLY_EQ_TOL((a), (b)))
 
@@ -71,7 +93,8 @@ void swap(T** a, T** b)
     *a = tmp;
 }
 
-double dot(const std::vector<double>& v1, const std::vector<double>& v2)
+template <class Vector>
+double dot(const Vector& v1, const Vector& v2)
 {
     double ret = 0.0;
     unsigned size = std::min(v1.size(), v2.size());